@@ -0,0 +1,137 @@
+# Build settings and dependencies (cubiomes, lua) that are shared by the
+# viewer and the search benchmark.
+
+# uncomment to override the profile compiler
+#QMAKE_CC = clang
+#QMAKE_CXX = clang++
+
+CHARSET                 = -finput-charset=UTF-8 -fexec-charset=UTF-8
+QMAKE_CFLAGS            = $$CHARSET -fwrapv -DSTRUCT_CONFIG_OVERRIDE=1
+QMAKE_CXXFLAGS          = $$QMAKE_CFLAGS
+QMAKE_CXXFLAGS_RELEASE  *= -O3 -g3
+
+greaterThan(QT_MAJOR_VERSION, 5) {
+    QMAKE_CXXFLAGS += -std=gnu++17
+    DEFINES += QT_DISABLE_DEPRECATED_UP_TO=0x050F00
+} else {
+    QMAKE_CXXFLAGS += -std=gnu++11
+    equals(QMAKE_CXX, g++) {
+        QMAKE_CXXFLAGS += -Wno-deprecated-copy
+    }
+}
+
+win32: {
+    CONFIG += static_gnu
+
+    # thank you nullprogram for dealing with the Windows UTF-16 nonsense
+    LIBWINSANE          = $$PWD/src/libwinsane
+    libwinsane.target   = libwinsane
+    libwinsane.output   = $$LIBWINSANE/libwinsane.o
+    libwinsane.commands = $(MAKE) -C $$LIBWINSANE -f $$LIBWINSANE/Makefile
+    QMAKE_EXTRA_TARGETS += libwinsane
+    PRE_TARGETDEPS      += libwinsane
+    LIBS                += $$LIBWINSANE/libwinsane.o
+} else {
+    DEFINES += "LUA_USE_POSIX=1"
+}
+
+wasm: {
+    DEFINES += "WASM=1"
+    #QT_WASM_SOURCE_MAP=1
+    QT_WASM_INITIAL_MEMORY = 256MB
+    QT_WASM_PTHREAD_POOL_SIZE = 32
+    CONFIG(debug, debug|release): {
+        #QMAKE_CFLAGS += -O3 -gsource-map
+    }
+}
+#CONFIG += sanitizer
+#CONFIG += sanitize_undefined
+#CONFIG += sanitize_thread
+
+static_gnu: {
+    LIBS += -static -static-libgcc -static-libstdc++
+}
+
+CONFIG(debug, debug|release): {
+    CUTARGET = debug
+} else {
+    CUTARGET = release
+}
+
+# compile cubiomes
+CUPATH              = $$PWD/cubiomes
+QMAKE_PRE_LINK      += $(MAKE) -C $$CUPATH -f $$CUPATH/makefile CC=\"$$QMAKE_CC\" CFLAGS=\"$(CFLAGS) $$QMAKE_CFLAGS\" $$CUTARGET
+QMAKE_CLEAN         += $$CUPATH/*.o $$CUPATH/libcubiomes.a
+LIBS                += $$CUPATH/libcubiomes.a -lm
+
+LUAPATH = $$PWD/lua/src
+
+SOURCES += \
+        $$LUAPATH/lapi.c \
+        $$LUAPATH/lauxlib.c \
+        $$LUAPATH/lbaselib.c \
+        $$LUAPATH/lcode.c \
+        $$LUAPATH/lcorolib.c \
+        $$LUAPATH/lctype.c \
+        $$LUAPATH/ldblib.c \
+        $$LUAPATH/ldebug.c \
+        $$LUAPATH/ldo.c \
+        $$LUAPATH/ldump.c \
+        $$LUAPATH/lfunc.c \
+        $$LUAPATH/lgc.c \
+        $$LUAPATH/linit.c \
+        $$LUAPATH/liolib.c \
+        $$LUAPATH/llex.c \
+        $$LUAPATH/lmathlib.c \
+        $$LUAPATH/lmem.c \
+        $$LUAPATH/loadlib.c \
+        $$LUAPATH/lobject.c \
+        $$LUAPATH/lopcodes.c \
+        $$LUAPATH/loslib.c \
+        $$LUAPATH/lparser.c \
+        $$LUAPATH/lstate.c \
+        $$LUAPATH/lstring.c \
+        $$LUAPATH/lstrlib.c \
+        $$LUAPATH/ltable.c \
+        $$LUAPATH/ltablib.c \
+        $$LUAPATH/ltm.c \
+        $$LUAPATH/lundump.c \
+        $$LUAPATH/lutf8lib.c \
+        $$LUAPATH/lvm.c \
+        $$LUAPATH/lzio.c
+
+HEADERS += \
+        $$CUPATH/finders.h \
+        $$CUPATH/generator.h \
+        $$CUPATH/layers.h \
+        $$CUPATH/biomes.h \
+        $$CUPATH/quadbase.h \
+        $$CUPATH/util.h \
+        $$LUAPATH/lapi.h \
+        $$LUAPATH/lauxlib.h \
+        $$LUAPATH/lcode.h \
+        $$LUAPATH/lctype.h \
+        $$LUAPATH/ldebug.h \
+        $$LUAPATH/ldo.h \
+        $$LUAPATH/lfunc.h \
+        $$LUAPATH/lgc.h \
+        $$LUAPATH/ljumptab.h \
+        $$LUAPATH/llex.h \
+        $$LUAPATH/llimits.h \
+        $$LUAPATH/lmem.h \
+        $$LUAPATH/lobject.h \
+        $$LUAPATH/lopcodes.h \
+        $$LUAPATH/lopnames.h \
+        $$LUAPATH/lparser.h \
+        $$LUAPATH/lprefix.h \
+        $$LUAPATH/lstate.h \
+        $$LUAPATH/lstring.h \
+        $$LUAPATH/ltable.h \
+        $$LUAPATH/ltm.h \
+        $$LUAPATH/lua.h \
+        $$LUAPATH/lua.hpp \
+        $$LUAPATH/luaconf.h \
+        $$LUAPATH/lualib.h \
+        $$LUAPATH/lundump.h \
+        $$LUAPATH/lvm.h \
+        $$LUAPATH/lzio.h
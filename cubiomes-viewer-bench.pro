@@ -0,0 +1,46 @@
+#-------------------------------------------------
+#
+# Search benchmark: runs the search core on the bundled example sessions
+# and reports the throughput as JSON. No windows or forms are built, the
+# shared sources still depend on the widgets module for their headers.
+#
+#-------------------------------------------------
+
+QT += core widgets
+
+CONFIG += console
+CONFIG -= app_bundle
+
+include(common.pri)
+
+TARGET = cubiomes-viewer-bench
+
+SOURCES += \
+        src/bench.cpp \
+        src/candcache.cpp \
+        src/config.cpp \
+        src/cpudispatch.cpp \
+        src/message.cpp \
+        src/scripts.cpp \
+        src/search.cpp \
+        src/searchthread.cpp \
+        src/seedbatch.cpp \
+        src/seedlist.cpp \
+        src/util.cpp
+
+HEADERS += \
+        src/candcache.h \
+        src/config.h \
+        src/cpudispatch.h \
+        src/message.h \
+        src/scripts.h \
+        src/search.h \
+        src/searchthread.h \
+        src/seedbatch.h \
+        src/seedlist.h \
+        src/seedtables.h \
+        src/util.h
+
+RESOURCES += \
+        rc/examples.qrc \
+        rc/qh.qrc
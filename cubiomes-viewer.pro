@@ -6,110 +6,17 @@
 
 QT += core widgets
 
-# uncomment to override the profile compiler
-#QMAKE_CC = clang
-#QMAKE_CXX = clang++
-
-CHARSET                 = -finput-charset=UTF-8 -fexec-charset=UTF-8
-QMAKE_CFLAGS            = $$CHARSET -fwrapv -DSTRUCT_CONFIG_OVERRIDE=1
-QMAKE_CXXFLAGS          = $$QMAKE_CFLAGS
-QMAKE_CXXFLAGS_RELEASE  *= -O3 -g3
-
-greaterThan(QT_MAJOR_VERSION, 5) {
-    QMAKE_CXXFLAGS += -std=gnu++17
-    DEFINES += QT_DISABLE_DEPRECATED_UP_TO=0x050F00
-} else {
-    QMAKE_CXXFLAGS += -std=gnu++11
-    equals(QMAKE_CXX, g++) {
-        QMAKE_CXXFLAGS += -Wno-deprecated-copy
-    }
-}
-
-win32: {
-    CONFIG += static_gnu
-
-    # thank you nullprogram for dealing with the Windows UTF-16 nonsense
-    LIBWINSANE          = $$PWD/src/libwinsane
-    libwinsane.target   = libwinsane
-    libwinsane.output   = $$LIBWINSANE/libwinsane.o
-    libwinsane.commands = $(MAKE) -C $$LIBWINSANE -f $$LIBWINSANE/Makefile
-    QMAKE_EXTRA_TARGETS += libwinsane
-    PRE_TARGETDEPS      += libwinsane
-    LIBS                += $$LIBWINSANE/libwinsane.o
-} else {
-    DEFINES += "LUA_USE_POSIX=1"
-}
-
-wasm: {
-    DEFINES += "WASM=1"
-    #QT_WASM_SOURCE_MAP=1
-    QT_WASM_INITIAL_MEMORY = 256MB
-    QT_WASM_PTHREAD_POOL_SIZE = 32
-    CONFIG(debug, debug|release): {
-        #QMAKE_CFLAGS += -O3 -gsource-map
-    }
-}
-#CONFIG += sanitizer
-#CONFIG += sanitize_undefined
-#CONFIG += sanitize_thread
-
-static_gnu: {
-    LIBS += -static -static-libgcc -static-libstdc++
-}
-
-CONFIG(debug, debug|release): {
-    CUTARGET = debug
-} else {
-    CUTARGET = release
-}
-
-# compile cubiomes
-CUPATH              = $$PWD/cubiomes
-QMAKE_PRE_LINK      += $(MAKE) -C $$CUPATH -f $$CUPATH/makefile CC=\"$$QMAKE_CC\" CFLAGS=\"$(CFLAGS) $$QMAKE_CFLAGS\" $$CUTARGET
-QMAKE_CLEAN         += $$CUPATH/*.o $$CUPATH/libcubiomes.a
-LIBS                += $$CUPATH/libcubiomes.a -lm
-
-LUAPATH = $$PWD/lua/src
+include(common.pri)
 
 TARGET = cubiomes-viewer
 
 SOURCES += \
-        $$LUAPATH/lapi.c \
-        $$LUAPATH/lauxlib.c \
-        $$LUAPATH/lbaselib.c \
-        $$LUAPATH/lcode.c \
-        $$LUAPATH/lcorolib.c \
-        $$LUAPATH/lctype.c \
-        $$LUAPATH/ldblib.c \
-        $$LUAPATH/ldebug.c \
-        $$LUAPATH/ldo.c \
-        $$LUAPATH/ldump.c \
-        $$LUAPATH/lfunc.c \
-        $$LUAPATH/lgc.c \
-        $$LUAPATH/linit.c \
-        $$LUAPATH/liolib.c \
-        $$LUAPATH/llex.c \
-        $$LUAPATH/lmathlib.c \
-        $$LUAPATH/lmem.c \
-        $$LUAPATH/loadlib.c \
-        $$LUAPATH/lobject.c \
-        $$LUAPATH/lopcodes.c \
-        $$LUAPATH/loslib.c \
-        $$LUAPATH/lparser.c \
-        $$LUAPATH/lstate.c \
-        $$LUAPATH/lstring.c \
-        $$LUAPATH/lstrlib.c \
-        $$LUAPATH/ltable.c \
-        $$LUAPATH/ltablib.c \
-        $$LUAPATH/ltm.c \
-        $$LUAPATH/lundump.c \
-        $$LUAPATH/lutf8lib.c \
-        $$LUAPATH/lvm.c \
-        $$LUAPATH/lzio.c \
         src/aboutdialog.cpp \
         src/biomecolordialog.cpp \
+        src/candcache.cpp \
         src/conditiondialog.cpp \
         src/config.cpp \
+        src/cpudispatch.cpp \
         src/configdialog.cpp \
         src/extgendialog.cpp \
         src/exportdialog.cpp \
@@ -118,15 +25,19 @@ SOURCES += \
         src/formsearchcontrol.cpp \
         src/gotodialog.cpp \
         src/headless.cpp \
+        src/journal.cpp \
         src/maptoolsdialog.cpp \
         src/message.cpp \
         src/presetdialog.cpp \
+        src/profiledialog.cpp \
         src/layerdialog.cpp \
         src/mapview.cpp \
         src/rangedialog.cpp \
         src/scripts.cpp \
         src/search.cpp \
         src/searchthread.cpp \
+        src/seedbatch.cpp \
+        src/seedlist.cpp \
         src/tabbiomes.cpp \
         src/tablocations.cpp \
         src/tabstructures.cpp \
@@ -137,44 +48,12 @@ SOURCES += \
         src/world.cpp
 
 HEADERS += \
-        $$CUPATH/finders.h \
-        $$CUPATH/generator.h \
-        $$CUPATH/layers.h \
-        $$CUPATH/biomes.h \
-        $$CUPATH/quadbase.h \
-        $$CUPATH/util.h \
-        $$LUAPATH/lapi.h \
-        $$LUAPATH/lauxlib.h \
-        $$LUAPATH/lcode.h \
-        $$LUAPATH/lctype.h \
-        $$LUAPATH/ldebug.h \
-        $$LUAPATH/ldo.h \
-        $$LUAPATH/lfunc.h \
-        $$LUAPATH/lgc.h \
-        $$LUAPATH/ljumptab.h \
-        $$LUAPATH/llex.h \
-        $$LUAPATH/llimits.h \
-        $$LUAPATH/lmem.h \
-        $$LUAPATH/lobject.h \
-        $$LUAPATH/lopcodes.h \
-        $$LUAPATH/lopnames.h \
-        $$LUAPATH/lparser.h \
-        $$LUAPATH/lprefix.h \
-        $$LUAPATH/lstate.h \
-        $$LUAPATH/lstring.h \
-        $$LUAPATH/ltable.h \
-        $$LUAPATH/ltm.h \
-        $$LUAPATH/lua.h \
-        $$LUAPATH/lua.hpp \
-        $$LUAPATH/luaconf.h \
-        $$LUAPATH/lualib.h \
-        $$LUAPATH/lundump.h \
-        $$LUAPATH/lvm.h \
-        $$LUAPATH/lzio.h \
         src/aboutdialog.h \
         src/biomecolordialog.h \
+        src/candcache.h \
         src/conditiondialog.h \
         src/config.h \
+        src/cpudispatch.h \
         src/configdialog.h \
         src/extgendialog.h \
         src/exportdialog.h \
@@ -183,9 +62,11 @@ HEADERS += \
         src/formsearchcontrol.h \
         src/gotodialog.h \
         src/headless.h \
+        src/journal.h \
         src/maptoolsdialog.h \
         src/message.h \
         src/presetdialog.h \
+        src/profiledialog.h \
         src/layerdialog.h \
         src/mapview.h \
         src/qzipwriter.h \
@@ -193,6 +74,8 @@ HEADERS += \
         src/scripts.h \
         src/search.h \
         src/searchthread.h \
+        src/seedbatch.h \
+        src/seedlist.h \
         src/seedtables.h \
         src/tabbiomes.h \
         src/tablocations.h \
@@ -215,6 +98,7 @@ FORMS += \
         src/gotodialog.ui \
         src/maptoolsdialog.ui \
         src/presetdialog.ui \
+        src/profiledialog.ui \
         src/layerdialog.ui \
         src/mainwindow.ui \
         src/rangedialog.ui \
@@ -244,9 +128,9 @@ TRANSLATIONS += \
 # enable network features with: qmake CONFIG+=with_network
 with_network: {
     QT += network
-    DEFINES += "WITH_UPDATER=1"
-    SOURCES += src/updater.cpp
-    HEADERS += src/updater.h
+    DEFINES += "WITH_UPDATER=1" "WITH_COORDINATOR=1"
+    SOURCES += src/updater.cpp src/coordinator.cpp
+    HEADERS += src/updater.h src/coordinator.h
 }
 
 # enable dbus features with: qmake CONFIG+=with_dbus
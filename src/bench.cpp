@@ -0,0 +1,196 @@
+#include "aboutdialog.h"
+#include "cpudispatch.h"
+#include "searchthread.h"
+
+#include <QCoreApplication>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QThread>
+#include <QTimer>
+
+#include <stdio.h>
+
+/* Search benchmark: runs bundled (or given) session files over a fixed seed
+ * range for a fixed time or seed count and reports the throughput as JSON.
+ */
+
+struct BenchRun
+{
+    QString name;
+    int threads;
+    uint64_t seeds;
+    double sec;
+    uint64_t results;
+};
+
+static bool loadSession(Session *session, QString path)
+{
+    QFile file(path);
+    if (!file.open(QFile::ReadOnly))
+        return false;
+    QTextStream stream(&file);
+    if (!session->load(nullptr, stream, true))
+        return false;
+    if (session->cv.empty())
+        return false;
+    // seed lists are not bundled, run those searches incrementally instead
+    if (session->sc.searchtype == SEARCH_LIST)
+        session->sc.searchtype = SEARCH_INC;
+    if (session->gen48.mode == GEN48_LIST)
+        session->gen48.mode = GEN48_AUTO;
+    session->slist.clear();
+    session->plan.clear();
+    return true;
+}
+
+static bool runBench(BenchRun *run, Session session, uint64_t start, int threads,
+    double maxsec, uint64_t maxseeds)
+{
+    session.sc.threads = threads;
+    session.sc.startseed = start;
+
+    SearchMaster sthread(nullptr);
+    if (!sthread.set(nullptr, session))
+        return false;
+
+    run->threads = threads;
+    run->seeds = 0;
+    run->sec = 0;
+    run->results = 0;
+
+    QObject::connect(&sthread, &SearchMaster::searchResults,
+        [&](QVector<uint64_t> seeds) { run->results += seeds.size(); });
+
+    QEventLoop loop;
+    QTimer timer;
+    QElapsedTimer elapsed;
+    uint64_t prog0 = 0;
+
+    auto update = [&]() {
+        QString status;
+        uint64_t prog, end, seed;
+        qreal min, avg, max;
+        sthread.getProgress(&status, &prog, &end, &seed, &min, &avg, &max);
+        run->seeds = prog > prog0 ? prog - prog0 : 0;
+        run->sec = elapsed.nsecsElapsed() * 1e-9;
+    };
+
+    QObject::connect(&sthread, &SearchMaster::searchFinish, &loop, &QEventLoop::quit);
+    QObject::connect(&timer, &QTimer::timeout, [&]() {
+        update();
+        if (run->sec >= maxsec || (maxseeds && run->seeds >= maxseeds))
+            loop.quit();
+    });
+
+    sthread.startSearch(); // includes the preparation of the search space
+    prog0 = sthread.prog;
+    elapsed.start();
+    timer.start(20);
+    if (!sthread.workers.empty())
+        loop.exec();
+    timer.stop();
+    update();
+    sthread.stopSearch();
+    // deliver the remaining results
+    QCoreApplication::processEvents();
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName(APP_STRING);
+
+    QStringList sessions;
+    QList<int> threadlist;
+    double maxsec = 10;
+    uint64_t maxseeds = 0;
+    uint64_t start = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--session=", 10) == 0)
+            sessions += argv[i] + 10;
+        else if (strncmp(argv[i], "--threads=", 10) == 0)
+        {
+            for (const QString& t : QString(argv[i] + 10).split(','))
+                if (t.toInt() > 0)
+                    threadlist += t.toInt();
+        }
+        else if (strncmp(argv[i], "--time=", 7) == 0)
+            maxsec = atof(argv[i] + 7);
+        else if (strncmp(argv[i], "--seeds=", 8) == 0)
+            maxseeds = strtoull(argv[i] + 8, NULL, 0);
+        else if (strncmp(argv[i], "--start=", 8) == 0)
+            start = strtoull(argv[i] + 8, NULL, 0);
+        else
+        {
+            const char *msg =
+                "Usage: cubiomes-viewer-bench [options]\n"
+                "Options:\n"
+                "      --session=file         Benchmark this session (repeatable),\n"
+                "                             default: the bundled examples.\n"
+                "      --threads=n[,n...]     Thread counts to run, default: all cores.\n"
+                "      --time=sec             Time limit per run, default: 10.\n"
+                "      --seeds=n              Seed count limit per run.\n"
+                "      --start=seed           First seed of the range, default: 0.\n"
+                "\n";
+            printf("%s", msg);
+            return strcmp(argv[i], "--help") == 0 ? 0 : 1;
+        }
+    }
+
+    if (sessions.empty())
+    {
+        QDirIterator it(":/examples");
+        while (it.hasNext())
+            sessions += it.next();
+        sessions.sort();
+    }
+    if (threadlist.empty())
+        threadlist += QThread::idealThreadCount();
+
+    QJsonArray runs;
+    for (const QString& path : qAsConst(sessions))
+    {
+        Session session;
+        if (!loadSession(&session, path))
+        {
+            fprintf(stderr, "Failed to load session: %s\n", path.toLocal8Bit().data());
+            continue;
+        }
+        for (int threads : qAsConst(threadlist))
+        {
+            BenchRun run;
+            run.name = QFileInfo(path).baseName();
+            if (!runBench(&run, session, start, threads, maxsec, maxseeds))
+            {
+                fprintf(stderr, "Failed to set up search: %s\n", path.toLocal8Bit().data());
+                break;
+            }
+            double rate = run.sec > 0 ? run.seeds / run.sec : 0;
+            QJsonObject obj;
+            obj["session"] = run.name;
+            obj["threads"] = run.threads;
+            obj["seeds"] = (qint64) run.seeds;
+            obj["seconds"] = run.sec;
+            obj["seeds_per_sec"] = rate;
+            obj["seeds_per_sec_per_thread"] = rate / run.threads;
+            obj["results"] = (qint64) run.results;
+            runs.append(obj);
+        }
+    }
+
+    QJsonObject root;
+    root["version"] = getVersStr();
+    root["isa"] = getCpuIsaName(getCpuIsa());
+    root["start"] = QString::number(start);
+    root["runs"] = runs;
+    printf("%s", QJsonDocument(root).toJson().data());
+    return 0;
+}
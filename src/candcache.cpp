@@ -0,0 +1,132 @@
+#include "candcache.h"
+
+#include "config.h"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QtEndian>
+
+#include <inttypes.h>
+#include <string.h>
+
+static const char g_magic[8] = "CVCANDS";
+enum { HEADER_SIZE = 40 };
+
+
+QString getCandidateDir()
+{
+    QString cdir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/candidates";
+    QDir dir(cdir);
+    if (!dir.exists())
+        dir.mkpath(".");
+    return cdir;
+}
+
+QString getCandidateKey(const QString& spec)
+{
+    // the structure salts and generator options of the candidates
+    QString ext = QString::asprintf("%d %d %d",
+        g_extgen.experimentalVers, g_extgen.estimateTerrain, g_extgen.saltOverride);
+    if (g_extgen.saltOverride)
+    {
+        for (int i = 0; i < FEATURE_NUM; i++)
+            ext += QString::asprintf(" %" PRIu64, g_extgen.salts[i]);
+    }
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(spec.toUtf8());
+    hash.addData(ext.toLatin1());
+    return QString(hash.result().toHex());
+}
+
+bool loadCandidates(const QString& dir, const QString& key, CandidateSet *cs)
+{
+    QFile f(dir + "/" + key + ".cand");
+    if (!f.open(QIODevice::ReadOnly))
+        return false;
+    qint64 size = f.size();
+    if (size < HEADER_SIZE)
+        return false;
+    const uchar *p = f.map(0, size);
+    if (!p || memcmp(p, g_magic, sizeof(g_magic)) != 0)
+        return false;
+    if (qFromLittleEndian<quint32>(p + 8) != CANDCACHE_VERSION)
+        return false;
+    uint64_t first = qFromLittleEndian<quint64>(p + 16);
+    uint64_t end = qFromLittleEndian<quint64>(p + 24);
+    uint64_t cnt = qFromLittleEndian<quint64>(p + 32);
+    // each seed takes at least one byte
+    if (first > end || cnt > (uint64_t)(size - HEADER_SIZE))
+        return false;
+
+    std::vector<uint64_t> seeds;
+    seeds.reserve(cnt);
+    const uchar *q = p + HEADER_SIZE, *qe = p + size;
+    uint64_t s = first;
+    for (uint64_t i = 0; i < cnt; i++)
+    {
+        uint64_t d = 0;
+        int shift = 0;
+        while (true)
+        {
+            if (q == qe || shift > 63)
+                return false;
+            uchar b = *q++;
+            d |= (uint64_t)(b & 0x7f) << shift;
+            shift += 7;
+            if (!(b & 0x80))
+                break;
+        }
+        // the seeds ascend from 'first', starting with a zero difference
+        if (i > 0 && d == 0)
+            return false;
+        s += d;
+        if (s >= end)
+            return false;
+        seeds.push_back(s);
+    }
+    if (q != qe)
+        return false;
+
+    cs->first = first;
+    cs->end = end;
+    cs->seeds.swap(seeds);
+    return true;
+}
+
+bool saveCandidates(const QString& dir, const QString& key, const CandidateSet& cs)
+{
+    QSaveFile f(dir + "/" + key + ".cand");
+    if (!f.open(QIODevice::WriteOnly))
+        return false;
+
+    uchar head[HEADER_SIZE] = {};
+    memcpy(head, g_magic, sizeof(g_magic));
+    qToLittleEndian<quint32>(CANDCACHE_VERSION, head + 8);
+    qToLittleEndian<quint64>(cs.first, head + 16);
+    qToLittleEndian<quint64>(cs.end, head + 24);
+    qToLittleEndian<quint64>(cs.seeds.size(), head + 32);
+    bool ok = f.write((const char*) head, sizeof(head)) == sizeof(head);
+
+    QByteArray buf;
+    uint64_t prev = cs.first;
+    for (size_t i = 0; i < cs.seeds.size() && ok; i++)
+    {
+        uint64_t d = cs.seeds[i] - prev;
+        prev = cs.seeds[i];
+        do {
+            uchar b = d & 0x7f;
+            d >>= 7;
+            buf.append((char) (d ? b | 0x80 : b));
+        } while (d);
+        if (buf.size() >= (1 << 20))
+        {
+            ok = f.write(buf) == buf.size();
+            buf.clear();
+        }
+    }
+    ok = ok && f.write(buf) == buf.size();
+    return ok && f.commit();
+}
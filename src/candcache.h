@@ -0,0 +1,43 @@
+#ifndef CANDCACHE_H
+#define CANDCACHE_H
+
+#include <QString>
+
+#include <vector>
+
+#include <stdint.h>
+
+/* The 48-bit candidates of a range of bases [first, end) that has been
+ * covered completely, such as the viable bases of a block search scan, or a
+ * whole candidate list (with the range [0, 2^48)).
+ */
+struct CandidateSet
+{
+    uint64_t first, end;
+    std::vector<uint64_t> seeds;    // sorted, without duplicates
+
+    CandidateSet() : first(), end(), seeds() {}
+};
+
+/* Candidate sets are cached in files that are named by a key, which hashes
+ * everything the candidates depend on. The seeds are stored as the varint
+ * encoded differences between them.
+ *
+ *  char[8]  "CVCANDS\0"
+ *  uint32   version
+ *  uint32   flags (0)
+ *  uint64   first, end
+ *  uint64   number of seeds
+ */
+enum { CANDCACHE_VERSION = 1 };
+
+// Directory of the cached candidate sets.
+QString getCandidateDir();
+
+// Cache key for a text that describes everything the candidates depend on.
+QString getCandidateKey(const QString& spec);
+
+bool loadCandidates(const QString& dir, const QString& key, CandidateSet *cs);
+bool saveCandidates(const QString& dir, const QString& key, const CandidateSet& cs);
+
+#endif // CANDCACHE_H
@@ -1652,6 +1652,13 @@ void ConditionDialog::on_pushInfoLua_clicked()
         "<dd>returns a list of <b>{x, z}</b> structure positions for the "
         "specified structure <b>type</b> within the area spanning the block "
         "positions <b>x1, z1</b> to <b>x2, z2</b>, or <b>nil</b> upon failure"
+        "</p><p>"
+        "<dt><b>getSpawn()</b>"
+        "<dd>returns the <b>{x, z}</b> world spawn position"
+        "</p><p>"
+        "<dt><b>getStrongholds()</b><dt><b>getStrongholds(n)</b>"
+        "<dd>returns a list of the <b>{x, z}</b> stronghold positions, "
+        "limited to the first <b>n</b> if specified"
         "</p></body></html>"
         ));
     mb->show();
@@ -354,6 +354,7 @@ void Config::reset()
     autosaveCycle = 10;
     uistyle = STYLE_SYSTEM;
     maxMatching = 65536;
+    sortMemory = 1024;
     gridSpacing = 0;
     gridMultiplier = 0;
     mapCacheSize = 256;
@@ -384,6 +385,7 @@ void Config::load(QSettings& settings)
     autosaveCycle = settings.value("config/autosaveCycle", autosaveCycle).toInt();
     uistyle = settings.value("config/uistyle", uistyle).toInt();
     maxMatching = settings.value("config/maxMatching", maxMatching).toInt();
+    sortMemory = settings.value("config/sortMemory", sortMemory).toInt();
     gridSpacing = settings.value("config/gridSpacing", gridSpacing).toInt();
     gridMultiplier = settings.value("config/gridMultiplier", gridMultiplier).toInt();
     mapCacheSize = settings.value("config/mapCacheSize", mapCacheSize).toInt();
@@ -407,6 +409,7 @@ void Config::save(QSettings& settings)
     settings.setValue("config/autosaveCycle", autosaveCycle);
     settings.setValue("config/uistyle", uistyle);
     settings.setValue("config/maxMatching", maxMatching);
+    settings.setValue("config/sortMemory", sortMemory);
     settings.setValue("config/gridSpacing", gridSpacing);
     settings.setValue("config/gridMultiplier", gridMultiplier);
     settings.setValue("config/mapCacheSize", mapCacheSize);
@@ -505,8 +508,8 @@ uint64_t Gen48Config::estimateSeedCnt(uint64_t slist48len)
     {
         uint64_t w = x2 - x1 + 1;
         uint64_t h = z2 - z1 + 1;
-        uint64_t n = w*h * cnt; // div sizeof(uint64_t)
-        if (cnt > 0 && n < PRECOMPUTE48_BUFSIZ * sizeof(uint64_t) && n / cnt == w*h)
+        uint64_t n = w*h * cnt; // (an upper bound, the moved seeds can coincide)
+        if (cnt > 0 && n <= MASK48 && n / cnt == w*h)
             cnt = n;
         else
             cnt = MASK48 + 1;
@@ -518,11 +521,16 @@ void SearchConfig::reset()
 {
     searchtype = SEARCH_INC;
     slist64path = "";
+    liststream = false;
     threads = QThread::idealThreadCount();
     startseed = 0;
+    startidx = ~(uint64_t)0;
     stoponres = true;
     smin = 0;
     smax = ~(uint64_t)0;
+    done = false;
+    shard = 0;
+    shards = 1;
 }
 
 bool SearchConfig::read(const QString& line)
@@ -532,11 +540,15 @@ bool SearchConfig::read(const QString& line)
     int tmp;
     if (sscanf(p, "#Search:   %d", &searchtype) == 1)       return true;
     if (line.startsWith("#List64:   "))                     { slist64path = line.mid(11).trimmed(); return true; }
+    if (sscanf(p, "#Stream:   %d", &tmp) == 1)              { liststream = tmp; return true; }
     if (sscanf(p, "#Threads:  %d", &threads) == 1)          return true;
     if (sscanf(p, "#Progress: %" PRIu64, &startseed) == 1)  return true;
+    if (sscanf(p, "#ListIdx:  %" PRIu64, &startidx) == 1)   return true;
     if (sscanf(p, "#ResStop:  %d", &tmp) == 1)              { stoponres = tmp; return true; }
     if (sscanf(p, "#SMin:     %" PRIu64, &smin) == 1)       return true;
     if (sscanf(p, "#SMax:     %" PRIu64, &smax) == 1)       return true;
+    if (sscanf(p, "#Shard:    %d/%d", &shard, &shards) == 2) return true;
+    if (sscanf(p, "#Done:     %d", &tmp) == 1)              { done = tmp; return true; }
     return false;
 }
 
@@ -545,13 +557,21 @@ void SearchConfig::write(QTextStream& stream)
     stream << "#Search:   " << searchtype << "\n";
     if (!slist64path.isEmpty())
         stream << "#List64:   " << slist64path.replace("\n", "") << "\n";
+    if (liststream)
+        stream << "#Stream:   1\n";
     stream << "#Progress: " << startseed << "\n";
+    if (startidx != ~(uint64_t)0)
+        stream << "#ListIdx:  " << startidx << "\n";
     stream << "#Threads:  " << threads << "\n";
     stream << "#ResStop:  " << (int)stoponres << "\n";
     if (smin != 0)
         stream << "#SMin:     " << smin << "\n";
     if (smax != ~(uint64_t)0)
         stream << "#SMax:     " << smax << "\n";
+    if (shards > 1)
+        stream << "#Shard:    " << shard << "/" << shards << "\n";
+    if (done)
+        stream << "#Done:     1\n";
     stream.flush();
 }
 
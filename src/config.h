@@ -13,7 +13,8 @@
 
 #define APP_STRING "cubiomes-viewer"
 
-#define PRECOMPUTE48_BUFSIZ ((int64_t)1 << 30)
+// larger 48-bit candidate lists are merged on the fly instead of precomputed
+#define PRECOMPUTE48_BUFSIZ ((int64_t)1 << 27)
 
 enum { MC_DEFAULT = MC_1_21_3 };
 
@@ -178,6 +179,7 @@ struct Config
     int autosaveCycle;
     int uistyle;
     int maxMatching;
+    int sortMemory;
     int gridSpacing;
     int gridMultiplier;
     int mapCacheSize;
@@ -229,11 +231,16 @@ struct SearchConfig
 {
     int searchtype;
     QString slist64path;
+    bool liststream; // read the 64-bit list as a stream (progress is a byte offset)
     int threads;
     uint64_t startseed;
+    uint64_t startidx; // list index of 'startseed' in a list search (~0 if unknown)
     bool stoponres;
     uint64_t smin;
     uint64_t smax;
+    bool done;      // the search space has been searched completely
+    int shard;      // part of the search space that is searched (of 'shards')
+    int shards;
 
     SearchConfig() { reset(); }
 
@@ -72,6 +72,7 @@ void ConfigDialog::initConfig(Config *config)
         ui->spinAutosave->setValue(config->autosaveCycle);
     ui->comboStyle->setCurrentIndex(config->uistyle);
     ui->lineMatching->setText(QString::number(config->maxMatching));
+    ui->spinSortMemory->setValue(config->sortMemory);
     ui->lineGridSpacing->setText(config->gridSpacing ? QString::number(config->gridSpacing) : "");
     ui->comboGridMult->setCurrentText(config->gridMultiplier ? QString::number(config->gridMultiplier) : tr("None"));
     ui->spinCacheSize->setValue(config->mapCacheSize);
@@ -97,6 +98,7 @@ Config ConfigDialog::getConfig()
     conf.autosaveCycle = ui->checkAutosave->isChecked() ? ui->spinAutosave->value() : 0;
     conf.uistyle = ui->comboStyle->currentIndex();
     conf.maxMatching = ui->lineMatching->text().toInt();
+    conf.sortMemory = ui->spinSortMemory->value();
     conf.gridSpacing = ui->lineGridSpacing->text().toInt();
     conf.gridMultiplier = ui->comboGridMult->currentText().toInt();
     conf.mapCacheSize = ui->spinCacheSize->value();
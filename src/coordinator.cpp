@@ -0,0 +1,753 @@
+#include "coordinator.h"
+
+#include "aboutdialog.h"
+#include "headless.h"
+#include "message.h"
+
+#include <QFileInfo>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QSettings>
+#include <QTcpServer>
+#include <QTcpSocket>
+
+#include <inttypes.h>
+#include <stdio.h>
+
+
+static QTextStream& qOut()
+{
+    static QTextStream out (stdout);
+    return out;
+}
+
+bool SocketAddress::parse(QString addr)
+{
+    local = true;
+    port = 0;
+    if (addr.startsWith("unix:"))
+    {
+        host = addr.mid(5);
+        return !host.isEmpty();
+    }
+    int i = addr.lastIndexOf(':');
+    if (i >= 0 && !addr.contains('/'))
+    {
+        bool ok;
+        uint p = addr.mid(i+1).toUInt(&ok);
+        if (!ok || p == 0 || p > 0xffff)
+            return false;
+        local = false;
+        port = p;
+        host = addr.left(i);
+        if (host.startsWith("[") && host.endsWith("]"))
+            host = host.mid(1, host.size()-2); // IPv6
+        if (host.isEmpty())
+            host = "localhost";
+        return true;
+    }
+    host = addr;
+    return !host.isEmpty();
+}
+
+QString SocketAddress::toString() const
+{
+    if (local)
+        return "unix:" + host;
+    return QString("%1:%2").arg(host).arg(port);
+}
+
+
+Coordinator::Coordinator(QString sessionpath, QString resultspath, QString address, QObject *parent)
+    : QObject(parent)
+    , sessionpath(sessionpath)
+    , resultspath(resultspath)
+    , address()
+    , session()
+    , sthread(nullptr)
+    , journal()
+    , sfirst()
+    , slast()
+    , empty(true)
+    , todo()
+    , leases()
+    , peers()
+    , nextlease()
+    , results()
+    , tcpserver()
+    , localserver()
+    , resultfile(resultspath)
+    , resultstream(stdout)
+    , progressfp()
+    , timer()
+    , elapsed()
+    , lastprint()
+{
+    this->address.parse(address);
+    sthread.isdone = true;
+
+    QSettings settings(APP_STRING, APP_STRING);
+    g_extgen.load(settings);
+
+    connect(&timer, &QTimer::timeout, this, &Coordinator::onTimeout);
+}
+
+Coordinator::~Coordinator()
+{
+    if (progressfp)
+        fclose(progressfp);
+}
+
+bool Coordinator::init()
+{
+    qOut() << "Loading session: \"" << sessionpath << "\"\n";
+    qOut().flush();
+
+    QFile file(sessionpath);
+    if (!file.open(QFile::ReadOnly))
+    {
+        warn(nullptr, "Path could not be opened.");
+        return false;
+    }
+    QTextStream stream(&file);
+    if (!session.load(nullptr, stream, false))
+        return false;
+    if (session.cv.empty())
+    {
+        warn(nullptr, "Session defines no search constraints.");
+        return false;
+    }
+    if (session.sc.searchtype == SEARCH_LIST && session.sc.liststream)
+    {   // leases need random access to the list
+        warn(nullptr, "A streamed seed list cannot be distributed.");
+        return false;
+    }
+    if (!loadSessionLists(&session))
+        return false;
+    if (!sthread.set(nullptr, session))
+        return false;
+
+    // map the search space as a search would, without starting it
+    sthread.preSearch();
+    sfirst = sthread.sbegin;
+    slast = sthread.sfull ? sthread.send : sthread.send - 1;
+    empty = sthread.isdone;
+    uint64_t start = sthread.prog;
+
+    // the journal belongs to this search space
+    QString key = getJournalKey(session, sfirst, slast);
+    QString jpath = (resultspath.isEmpty() ? sessionpath : resultspath) + ".journal";
+    if (!journal.open(jpath, key))
+    {
+        warn(nullptr, QString("Journal \"%1\" could not be opened or belongs to a different search.").arg(jpath));
+        return false;
+    }
+    if (!empty)
+    {
+        if (start > sfirst && journal.done.empty())
+            journal.addRange(sfirst, start - 1); // progress of the session
+        addTodo(sfirst, slast);
+        for (const auto& r : journal.done)
+            removeTodo(r.first, r.second);
+    }
+    results.insert(journal.results.begin(), journal.results.end());
+    journal.flush();
+    return true;
+}
+
+void Coordinator::run()
+{
+    elapsed.start();
+    if (!init())
+    {
+        finish(false);
+        return;
+    }
+
+    if (!resultfile.fileName().isEmpty())
+    {
+        if (resultfile.open(QIODevice::ReadWrite | QIODevice::Truncate | QIODevice::Text))
+            resultstream.setDevice(&resultfile);
+        else
+            warn(nullptr, "Output file for results coult not be created - using stdout instead.");
+    }
+    session.writeHeader(resultstream);
+    resultstream.flush();
+    if (resultfile.isOpen())
+    {
+        // reserve a progress field that is updated as leases complete
+        QByteArray path = QFileInfo(resultfile).absoluteFilePath().toLocal8Bit();
+        progressfp = fopen(path.data(), "rb+");
+        if (progressfp)
+        {
+            fseek(progressfp, resultfile.size(), SEEK_SET);
+            resultstream << QString::asprintf("#Progress: %20" PRId64 "\n", session.sc.startseed);
+            if (sthread.searchtype == SEARCH_LIST && !sthread.streaming)
+                resultstream << QString::asprintf("#ListIdx:  %20" PRIu64 "\n", session.sc.startidx);
+            resultstream << QString::asprintf("#Done:     %d\n", 0);
+            resultstream.flush();
+        }
+    }
+    for (uint64_t s : results)
+        resultstream << (int64_t) s << "\n";
+    resultstream.flush();
+    writeProgress();
+
+    if (todo.empty())
+    {
+        finish(true);
+        return;
+    }
+
+    bool ok;
+    if (address.local)
+    {
+        localserver = new QLocalServer(this);
+        QLocalServer::removeServer(address.host);
+        connect(localserver, &QLocalServer::newConnection, this, &Coordinator::onConnection);
+        ok = localserver->listen(address.host);
+    }
+    else
+    {
+        QHostAddress host;
+        if (address.host == "localhost")
+            host = QHostAddress::LocalHost;
+        else if (address.host == "*")
+            host = QHostAddress::Any;
+        else
+            host = QHostAddress(address.host);
+        tcpserver = new QTcpServer(this);
+        connect(tcpserver, &QTcpServer::newConnection, this, &Coordinator::onConnection);
+        ok = tcpserver->listen(host, address.port);
+    }
+    if (!ok)
+    {
+        warn(nullptr, QString("Failed to listen on %1.").arg(address.toString()));
+        finish(false);
+        return;
+    }
+
+    qOut() << "Serving leases on " << address.toString() << "\n";
+    qOut().flush();
+    timer.start(1000);
+}
+
+void Coordinator::onConnection()
+{
+    while (true)
+    {
+        QIODevice *dev = nullptr;
+        QString name;
+        if (localserver && localserver->hasPendingConnections())
+        {
+            QLocalSocket *s = localserver->nextPendingConnection();
+            connect(s, &QLocalSocket::readyRead, this, &Coordinator::onReadyRead);
+            connect(s, &QLocalSocket::disconnected, this, &Coordinator::onDisconnected);
+            name = QString("local#%1").arg(s->socketDescriptor());
+            dev = s;
+        }
+        else if (tcpserver && tcpserver->hasPendingConnections())
+        {
+            QTcpSocket *s = tcpserver->nextPendingConnection();
+            connect(s, &QTcpSocket::readyRead, this, &Coordinator::onReadyRead);
+            connect(s, &QTcpSocket::disconnected, this, &Coordinator::onDisconnected);
+            name = QString("%1:%2").arg(s->peerAddress().toString()).arg(s->peerPort());
+            dev = s;
+        }
+        if (!dev)
+            break;
+        Peer peer = { name, -1, 0 };
+        peers[dev] = peer;
+        qOut() << "Worker connected: " << name << "\n";
+        qOut().flush();
+    }
+}
+
+void Coordinator::onReadyRead()
+{
+    QIODevice *dev = qobject_cast<QIODevice*>(sender());
+    while (dev && dev->canReadLine() && peers.count(dev))
+        handleLine(dev, dev->readLine().trimmed());
+}
+
+void Coordinator::onDisconnected()
+{
+    QIODevice *dev = qobject_cast<QIODevice*>(sender());
+    auto it = peers.find(dev);
+    if (it == peers.end())
+        return;
+    qOut() << "Worker disconnected: " << it->second.name << "\n";
+    qOut().flush();
+    if (it->second.lease >= 0)
+        reclaimLease(it->second.lease);
+    // (the device may be reused by another connection)
+    for (auto& l : leases)
+    {
+        if (l.second.owner == dev)
+            l.second.owner = nullptr;
+    }
+    peers.erase(it);
+    dev->deleteLater();
+}
+
+void Coordinator::send(QIODevice *dev, const QString& msg)
+{
+    dev->write((msg + "\n").toLatin1());
+}
+
+void Coordinator::handleLine(QIODevice *dev, const QByteArray& line)
+{
+    Peer& peer = peers[dev];
+    QList<QByteArray> args = line.split(' ');
+    const QByteArray& cmd = args[0];
+    int id = args.size() > 1 ? args[1].toInt() : -1;
+    auto lit = leases.find(id);
+    if (lit != leases.end() && lit->second.peer == dev)
+        lit->second.seen = elapsed.elapsed();
+
+    if (cmd == "HELLO")
+    {
+        if (args.size() < 2 || QString(args[1]) != getVersStr())
+        {
+            send(dev, "ERROR The worker has a different version: " + getVersStr());
+            return;
+        }
+        QString header;
+        QTextStream stream(&header);
+        session.writeHeader(stream);
+        send(dev, QString("SESSION %1").arg(header.count('\n')));
+        dev->write(header.toLatin1());
+    }
+    else if (cmd == "LEASE")
+    {
+        if (args.size() > 1)
+            peer.rate = args[1].toDouble();
+        if (peer.lease >= 0)
+            reclaimLease(peer.lease);
+        if (grantLease(dev, peer))
+            return;
+        bool active = false;
+        for (const auto& l : leases)
+            active |= (l.second.peer != nullptr);
+        send(dev, active ? "WAIT" : "DONE");
+    }
+    else if (cmd == "RESULT" && args.size() > 2)
+    {
+        addResult(args[2].toULongLong());
+    }
+    else if (cmd == "PROGRESS" && args.size() > 2)
+    {
+        if (lit != leases.end() && lit->second.peer == dev)
+            lit->second.pos = args[2].toULongLong();
+    }
+    else if (cmd == "FINISH")
+    {   // a reclaimed lease can still be completed by its former owner
+        if (lit != leases.end() && (lit->second.peer == dev ||
+            (!lit->second.peer && lit->second.owner == dev)))
+            finishLease(id);
+    }
+}
+
+bool Coordinator::grantLease(QIODevice *dev, Peer& peer)
+{
+    if (todo.empty())
+        return false;
+
+    // size the lease for a fixed time with the speed of the worker
+    const double minsize = 0x10000, maxsize = 1e15;
+    double want = peer.rate * LEASE_SEC;
+    uint64_t size = (uint64_t) (want < minsize ? minsize : want > maxsize ? maxsize : want);
+
+    auto it = todo.begin();
+    uint64_t first = it->first;
+    uint64_t end = it->second;
+    uint64_t last = end;
+    if (last - first >= size)
+    {
+        last = first + size - 1;
+        if (session.sc.searchtype == SEARCH_BLOCKS)
+            last |= 0xffff; // whole 48-bit bases
+        if (last > end)
+            last = end;
+    }
+    todo.erase(it);
+    if (last < end)
+        todo[last + 1] = end;
+
+    int id = nextlease++;
+    Lease lease = { first, last, dev, dev, elapsed.elapsed(), first };
+    leases[id] = lease;
+    peer.lease = id;
+    send(dev, QString("LEASE %1 %2 %3").arg(id).arg(first).arg(last));
+    return true;
+}
+
+void Coordinator::reclaimLease(int id)
+{
+    auto it = leases.find(id);
+    if (it == leases.end() || !it->second.peer)
+        return;
+    Lease& lease = it->second;
+    auto pit = peers.find(lease.peer);
+    if (pit != peers.end())
+    {
+        qOut() << "Reclaimed lease " << id << " of " << pit->second.name << "\n";
+        qOut().flush();
+        pit->second.lease = -1;
+    }
+    // the lease remains known, in case the worker completes it after all
+    lease.peer = nullptr;
+    addTodo(lease.first, lease.last);
+}
+
+void Coordinator::finishLease(int id)
+{
+    Lease lease = leases[id];
+    leases.erase(id);
+    if (lease.peer)
+    {
+        auto pit = peers.find(lease.peer);
+        if (pit != peers.end() && pit->second.lease == id)
+            pit->second.lease = -1;
+    }
+    else
+    {   // completed late, after it was reclaimed
+        removeTodo(lease.first, lease.last);
+    }
+    journal.addRange(lease.first, lease.last);
+    journal.flush();
+    writeProgress();
+
+    bool active = false;
+    for (const auto& l : leases)
+        active |= (l.second.peer != nullptr);
+    if (todo.empty() && !active)
+        finish(true);
+}
+
+void Coordinator::addTodo(uint64_t first, uint64_t last)
+{
+    todo[first] = last;
+}
+
+void Coordinator::removeTodo(uint64_t first, uint64_t last)
+{
+    auto it = todo.upper_bound(first);
+    if (it != todo.begin())
+        --it;
+    while (it != todo.end() && it->first <= last)
+    {
+        uint64_t a = it->first, b = it->second;
+        if (b < first)
+        {
+            ++it;
+            continue;
+        }
+        it = todo.erase(it);
+        if (a < first)
+            todo[a] = first - 1;
+        if (b > last)
+            todo[last + 1] = b;
+    }
+}
+
+void Coordinator::addResult(uint64_t seed)
+{
+    if (!results.insert(seed).second)
+        return; // already found in a reclaimed lease
+    journal.addResult(seed);
+    resultstream << (int64_t) seed << "\n";
+    resultstream.flush();
+}
+
+void Coordinator::writeProgress()
+{
+    // resume point: the end of the contiguous completed range
+    uint64_t pos = sfirst;
+    uint64_t seed = sthread.smax;
+    bool pending = !empty && journal.nextPending(&pos, slast);
+    if (pending)
+        seed = sthread.seedAt(pos);
+    else
+        pos = slast + 1;
+    if (progressfp)
+    {
+        long fpos = ftell(progressfp);
+        fprintf(progressfp, "#Progress: %20" PRId64 "\n", seed);
+        if (sthread.searchtype == SEARCH_LIST && !sthread.streaming)
+            fprintf(progressfp, "#ListIdx:  %20" PRIu64 "\n", pos); // (position = index)
+        fprintf(progressfp, "#Done:     %d\n", (int) !pending);
+        fflush(progressfp);
+        fseek(progressfp, fpos, SEEK_SET);
+    }
+}
+
+void Coordinator::printStatus()
+{
+    double total = (double) (slast - sfirst) + 1;
+    double done = 0;
+    for (const auto& r : journal.done)
+        done += (double) (r.second - r.first) + 1;
+    int active = 0;
+    for (const auto& l : leases)
+        active += (l.second.peer != nullptr);
+    qint64 sec = elapsed.elapsed() / 1000;
+    qOut() << QString::asprintf("[%d:%02d:%02d] progress: %6.2f%%  workers: %d  leases: %d  results: %d\n",
+        (int)(sec / 3600), (int)(sec / 60) % 60, (int)(sec % 60),
+        100 * done / total, (int) peers.size(), active, (int) results.size());
+    qOut().flush();
+}
+
+void Coordinator::onTimeout()
+{
+    qint64 now = elapsed.elapsed();
+    for (auto& l : leases)
+    {
+        if (l.second.peer && now - l.second.seen > LEASE_TIMEOUT_SEC * 1000)
+            reclaimLease(l.first);
+    }
+    journal.flush();
+    if (now - lastprint >= 10000)
+    {
+        lastprint = now;
+        printStatus();
+    }
+}
+
+void Coordinator::finish(bool done)
+{
+    timer.stop();
+    writeProgress();
+    journal.flush();
+    if (progressfp)
+    {
+        fclose(progressfp);
+        progressfp = NULL;
+    }
+    if (done)
+    {
+        printStatus();
+        qOut() << "Search done!\n";
+    }
+    qOut() << "Stopping event loop.\n";
+    qOut().flush();
+    emit finished();
+}
+
+
+LeaseWorker::LeaseWorker(QString address, QObject *parent)
+    : QObject(parent)
+    , address()
+    , dev()
+    , sthread(nullptr)
+    , leaseid(-1)
+    , headerlines()
+    , header()
+    , rate()
+    , timer()
+    , stopped()
+{
+    this->address.parse(address);
+    sthread.isdone = true;
+
+    QSettings settings(APP_STRING, APP_STRING);
+    g_extgen.load(settings);
+
+    connect(&sthread, &SearchMaster::searchResults, this, &LeaseWorker::onResults, Qt::QueuedConnection);
+    connect(&sthread, &SearchMaster::searchFinish, this, &LeaseWorker::onFinish, Qt::QueuedConnection);
+    connect(&timer, &QTimer::timeout, this, &LeaseWorker::onTimeout);
+}
+
+LeaseWorker::~LeaseWorker()
+{
+}
+
+void LeaseWorker::run()
+{
+    qOut() << "Connecting to coordinator: " << address.toString() << "\n";
+    qOut().flush();
+
+    bool ok;
+    if (address.local)
+    {
+        QLocalSocket *s = new QLocalSocket(this);
+        connect(s, &QLocalSocket::readyRead, this, &LeaseWorker::onReadyRead);
+        connect(s, &QLocalSocket::disconnected, this, &LeaseWorker::onDisconnected);
+        s->connectToServer(address.host);
+        ok = s->waitForConnected(10000);
+        dev = s;
+    }
+    else
+    {
+        QTcpSocket *s = new QTcpSocket(this);
+        connect(s, &QTcpSocket::readyRead, this, &LeaseWorker::onReadyRead);
+        connect(s, &QTcpSocket::disconnected, this, &LeaseWorker::onDisconnected);
+        s->connectToHost(address.host, address.port);
+        ok = s->waitForConnected(10000);
+        dev = s;
+    }
+    if (!ok)
+    {
+        warn(nullptr, QString("Failed to connect to %1.").arg(address.toString()));
+        quit();
+        return;
+    }
+    send("HELLO " + getVersStr());
+}
+
+void LeaseWorker::send(const QString& msg)
+{
+    if (dev && dev->isOpen())
+        dev->write((msg + "\n").toLatin1());
+}
+
+void LeaseWorker::onReadyRead()
+{
+    while (!stopped && dev->canReadLine())
+        handleLine(dev->readLine());
+}
+
+void LeaseWorker::handleLine(const QByteArray& line)
+{
+    if (headerlines > 0)
+    {
+        header += QString::fromLatin1(line);
+        if (--headerlines == 0)
+        {
+            if (!setup())
+                quit();
+            else
+                requestLease();
+        }
+        return;
+    }
+
+    QList<QByteArray> args = line.trimmed().split(' ');
+    const QByteArray& cmd = args[0];
+    if (cmd == "SESSION" && args.size() > 1)
+    {
+        header.clear();
+        headerlines = args[1].toInt();
+    }
+    else if (cmd == "LEASE" && args.size() > 3)
+    {
+        leaseid = args[1].toInt();
+        uint64_t first = args[2].toULongLong();
+        uint64_t last = args[3].toULongLong();
+        qOut() << "Lease " << leaseid << ": [" << first << ", " << last << "]\n";
+        qOut().flush();
+        if (!sthread.setLease(first, last))
+        {
+            quit();
+            return;
+        }
+        sthread.startSearch();
+        timer.start(1000);
+    }
+    else if (cmd == "WAIT")
+    {
+        QTimer::singleShot(1000, this, &LeaseWorker::requestLease);
+    }
+    else if (cmd == "DONE")
+    {
+        qOut() << "Search done!\n";
+        quit();
+    }
+    else if (cmd == "ERROR")
+    {
+        warn(nullptr, QString::fromLatin1(line.mid(6).trimmed()));
+        quit();
+    }
+}
+
+bool LeaseWorker::setup()
+{
+    Session session;
+    QTextStream stream(&header);
+    if (!session.load(nullptr, stream, true))
+    {
+        warn(nullptr, "Failed to load the session of the coordinator.");
+        return false;
+    }
+    if (session.sc.searchtype == SEARCH_LIST && session.sc.liststream)
+    {   // (as in Coordinator::init)
+        warn(nullptr, "A streamed seed list cannot be distributed.");
+        return false;
+    }
+    if (!loadSessionLists(&session))
+        return false;
+    // the leases define the searched range, the threads are our own
+    session.sc.threads = QThread::idealThreadCount();
+    session.sc.startseed = 0;
+    session.sc.shard = 0;
+    session.sc.shards = 1;
+    if (!sthread.set(nullptr, session))
+        return false;
+    // generate the candidates before the first lease runs on the clock
+    sthread.preSearch();
+
+    qOut() << "Condition summary:\n";
+    for (const Condition& cond : qAsConst(session.cv))
+        qOut() << cond.summary(false) << "\n";
+    qOut().flush();
+    return true;
+}
+
+void LeaseWorker::requestLease()
+{
+    if (!stopped)
+        send(QString("LEASE %1").arg(rate, 0, 'f', 0));
+}
+
+void LeaseWorker::onResults(QVector<uint64_t> seeds)
+{
+    for (uint64_t s : qAsConst(seeds))
+        send(QString("RESULT %1 %2").arg(leaseid).arg(s));
+}
+
+void LeaseWorker::onFinish(bool done)
+{
+    timer.stop();
+    if (stopped || leaseid < 0)
+        return;
+    if (!done)
+    {
+        quit();
+        return;
+    }
+    send(QString("FINISH %1").arg(leaseid));
+    leaseid = -1;
+    requestLease();
+}
+
+void LeaseWorker::onTimeout()
+{
+    QString status;
+    uint64_t prog, end, seed;
+    qreal min, avg, max;
+    sthread.getProgress(&status, &prog, &end, &seed, &min, &avg, &max);
+    if (avg > 0)
+        rate = avg;
+    send(QString("PROGRESS %1 %2").arg(leaseid).arg(sthread.getPosition()));
+}
+
+void LeaseWorker::onDisconnected()
+{
+    if (stopped)
+        return;
+    qOut() << "Connection to the coordinator was closed.\n";
+    qOut().flush();
+    quit();
+}
+
+void LeaseWorker::quit()
+{
+    if (stopped)
+        return;
+    stopped = true;
+    timer.stop();
+    sthread.stopSearch();
+    if (dev)
+        dev->close();
+    emit finished();
+}
@@ -0,0 +1,165 @@
+#ifndef COORDINATOR_H
+#define COORDINATOR_H
+
+#include "journal.h"
+#include "searchthread.h"
+
+#include <QElapsedTimer>
+#include <QIODevice>
+#include <QObject>
+#include <QTimer>
+
+#include <map>
+#include <set>
+
+class QLocalServer;
+class QTcpServer;
+
+/* Distributed search over a TCP or local (Unix) socket.
+ *
+ * The coordinator serves leases on ranges of the progress positions of a
+ * session to worker processes, which search them with their own threads and
+ * stream back the results and a heartbeat. The leases of workers that go
+ * silent are reclaimed and handed out again. Completed leases and results
+ * are logged in a journal, from which the whole run can be resumed.
+ *
+ * Protocol (one message per line):
+ *  W: HELLO <version>
+ *  C: SESSION <n>              followed by n lines of the session header
+ *  W: LEASE <rate>             request work, with the positions/sec so far
+ *  C: LEASE <id> <first> <last> | WAIT | DONE | ERROR <message>
+ *  W: RESULT <id> <seed>
+ *  W: PROGRESS <id> <pos>      heartbeat with the lowest pending position
+ *  W: FINISH <id>              lease completed (after all of its results)
+ */
+
+struct SocketAddress
+{
+    bool local;     // local socket (name or path) instead of TCP
+    QString host;
+    quint16 port;
+
+    // "host:port" for TCP, otherwise a local socket ("unix:" is optional)
+    bool parse(QString addr);
+    QString toString() const;
+};
+
+class Coordinator : public QObject
+{
+    Q_OBJECT
+
+public:
+    Coordinator(QString sessionpath, QString resultspath, QString address, QObject *parent = 0);
+    virtual ~Coordinator();
+
+public slots:
+    void run();
+
+signals:
+    void finished();
+
+private slots:
+    void onConnection();
+    void onReadyRead();
+    void onDisconnected();
+    void onTimeout();
+
+private:
+    struct Lease
+    {
+        uint64_t first, last;
+        QIODevice *peer;    // null once reclaimed
+        QIODevice *owner;   // the worker it was granted to (null once gone)
+        qint64 seen;        // time of the last message (ms)
+        uint64_t pos;       // reported progress
+    };
+    struct Peer
+    {
+        QString name;
+        int lease;          // active lease or -1
+        double rate;        // reported positions/sec
+    };
+
+    bool init();
+    void handleLine(QIODevice *dev, const QByteArray& line);
+    void send(QIODevice *dev, const QString& msg);
+    bool grantLease(QIODevice *dev, Peer& peer);
+    void reclaimLease(int id);
+    void finishLease(int id);
+    void addTodo(uint64_t first, uint64_t last);
+    void removeTodo(uint64_t first, uint64_t last);
+    void addResult(uint64_t seed);
+    void writeProgress();
+    void printStatus();
+    void finish(bool done);
+
+    // time a lease should take with the reported speed of a worker
+    enum { LEASE_SEC = 30 };
+    // silence after which a lease is reclaimed
+    enum { LEASE_TIMEOUT_SEC = 60 };
+
+    QString sessionpath;
+    QString resultspath;
+    SocketAddress address;
+    Session session;
+    SearchMaster sthread;   // maps the search space, it is never started
+    SearchJournal journal;
+
+    uint64_t sfirst, slast; // the search space
+    bool empty;
+    std::map<uint64_t, uint64_t> todo;  // unassigned ranges (first -> last)
+    std::map<int, Lease> leases;
+    std::map<QIODevice*, Peer> peers;
+    int nextlease;
+    std::set<uint64_t> results;
+
+    QTcpServer *tcpserver;
+    QLocalServer *localserver;
+    QFile resultfile;
+    QTextStream resultstream;
+    FILE *progressfp;
+    QTimer timer;
+    QElapsedTimer elapsed;
+    qint64 lastprint;
+};
+
+class LeaseWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    LeaseWorker(QString address, QObject *parent = 0);
+    virtual ~LeaseWorker();
+
+public slots:
+    void run();
+
+signals:
+    void finished();
+
+private slots:
+    void onReadyRead();
+    void onDisconnected();
+    void onResults(QVector<uint64_t> seeds);
+    void onFinish(bool done);
+    void onTimeout();
+    void requestLease();
+
+private:
+    void handleLine(const QByteArray& line);
+    void send(const QString& msg);
+    bool setup();
+    void quit();
+
+    SocketAddress address;
+    QIODevice *dev;
+    SearchMaster sthread;
+    int leaseid;
+    int headerlines;        // pending lines of the session header
+    QString header;
+    double rate;
+    QTimer timer;
+    bool stopped;
+};
+
+#endif // COORDINATOR_H
@@ -0,0 +1,181 @@
+#include "cpudispatch.h"
+
+#include "cubiomes/finders.h"
+
+#include <algorithm>
+#include <cmath>
+
+#define MASK48  ((1ULL << 48) - 1)
+
+
+static int detectCpuIsa()
+{
+#if CPU_DISPATCH_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+        return ISA_AVX512;
+    if (__builtin_cpu_supports("avx2"))
+        return ISA_AVX2;
+    if (__builtin_cpu_supports("sse4.2"))
+        return ISA_SSE42;
+#endif
+    return ISA_DEFAULT;
+}
+
+int getCpuIsa()
+{
+    static const int isa = detectCpuIsa();
+    return isa;
+}
+
+const char *getCpuIsaName(int isa)
+{
+    switch (isa)
+    {
+    case ISA_SSE42:     return "sse4.2";
+    case ISA_AVX2:      return "avx2";
+    case ISA_AVX512:    return "avx512";
+    default:            return "default";
+    }
+}
+
+
+static ISA_INLINE
+void climateToGray(unsigned char *rgb, const int *para, int n, int cmin, int cmax)
+{
+    for (int i = 0; i < n; i++)
+    {
+        double p = (para[i] - cmin) / (double) (cmax - cmin);
+        unsigned char col = (p <= 0) ? 0 : (p >= 1.0) ? 0xff : (unsigned char)(0xff * p);
+        rgb[3*i+0] = rgb[3*i+1] = rgb[3*i+2] = col;
+    }
+}
+
+static ISA_INLINE
+void shadeHeight(unsigned char *rgb, const float *height, int w, int h,
+    bool gray, bool shading, bool contours, float mul, float ymax)
+{
+    const float lout = 0.65;
+    const float lmin = 0.5;
+    const float lmax = 1.5;
+    const float spacing = 16.0;
+    const int tw = w+2;
+    for (int j = 0; j < h; j++)
+    {
+        const float *row = height + (j+1)*tw + 1;
+        unsigned char *col = rgb + 3*j*w;
+        if (gray)
+        {
+            for (int i = 0; i < w; i++, col += 3)
+            {
+                float v = row[i];
+                unsigned char c = (v <= 0) ? 0 : (v > 0xff) ? 0xff : (unsigned char)(v);
+                if (v <= -64)
+                {   // sinkhole in 1.19.0 - 1.19.2
+                    col[0] = 0xff; col[1] = col[2] = 0;
+                }
+                else
+                {
+                    col[0] = col[1] = col[2] = c;
+                }
+            }
+            continue;
+        }
+        for (int i = 0; i < w; i++, col += 3)
+        {
+            float t01 = row[i-tw];
+            float t10 = row[i-1];
+            float t11 = row[i];
+            float t12 = row[i+1];
+            float t21 = row[i+tw];
+            float light = 1.0;
+            if (shading)
+                light += ((t12 + t21) - (t01 + t10)) * mul;
+            if (t11 > ymax) light = lout;
+            if (light < lmin) light = lmin;
+            if (light > lmax) light = lmax;
+            if (contours)
+            {
+                float tmin = std::min(std::min(t01, t10), std::min(t12, t21));
+                if (std::floor(tmin / spacing) != std::floor(t11 / spacing))
+                    light *= 0.5;
+            }
+            for (int k = 0; k < 3; k++)
+            {
+                float c = col[k] * light;
+                col[k] = (c <= 0) ? 0 : (c > 0xff) ? 0xff : (unsigned char)(c);
+            }
+        }
+    }
+}
+
+static ISA_INLINE
+void mapSlime(unsigned char *out, int stride, uint64_t seed, int x, int z, int w, int h)
+{
+    const uint64_t K = 0x5deece66dULL;
+    for (int j = 0; j < h; j++, out += stride)
+    {
+        uint64_t zs = seed + slimeOffset(0, z+j);
+        for (int i = 0; i < w; i++)
+        {
+            uint64_t s = (zs + slimeOffset(x+i, 0)) ^ 0x3ad8025fULL ^ K;
+            s = (s * K + 0xb) & MASK48;
+            uint32_t bits = (uint32_t)(s >> 17);
+            uint32_t val = bits % 10;
+            // Java's nextInt() draws again when the remainder is biased
+            out[i] = (bits - val + 9 > 0x7fffffffU) ? 2 : (val == 0);
+        }
+        for (int i = 0; i < w; i++)
+        {
+            if (out[i] == 2)
+                out[i] = isSlimeChunk(seed, x+i, z+j) != 0;
+        }
+    }
+}
+
+static ISA_INLINE
+void offsetSeeds(uint64_t *out, const uint64_t *in, size_t n, uint64_t add)
+{
+    for (size_t i = 0; i < n; i++)
+        out[i] = (in[i] + add) & MASK48;
+}
+
+
+#define ISA_VARIANT(TARGET, SUFFIX) \
+    TARGET static void climateToGray_##SUFFIX(unsigned char *rgb, \
+        const int *para, int n, int cmin, int cmax) \
+    { climateToGray(rgb, para, n, cmin, cmax); } \
+    TARGET static void shadeHeight_##SUFFIX(unsigned char *rgb, \
+        const float *height, int w, int h, bool gray, bool shading, \
+        bool contours, float mul, float ymax) \
+    { shadeHeight(rgb, height, w, h, gray, shading, contours, mul, ymax); } \
+    TARGET static void mapSlime_##SUFFIX(unsigned char *out, int stride, \
+        uint64_t seed, int x, int z, int w, int h) \
+    { mapSlime(out, stride, seed, x, z, w, h); } \
+    TARGET static void offsetSeeds_##SUFFIX(uint64_t *out, \
+        const uint64_t *in, size_t n, uint64_t add) \
+    { offsetSeeds(out, in, n, add); } \
+    static const CpuKernels g_kernels_##SUFFIX = { \
+        climateToGray_##SUFFIX, shadeHeight_##SUFFIX, \
+        mapSlime_##SUFFIX, offsetSeeds_##SUFFIX, \
+    };
+
+ISA_VARIANT(, default)
+#if CPU_DISPATCH_X86
+ISA_VARIANT(ISA_TARGET_SSE42, sse42)
+ISA_VARIANT(ISA_TARGET_AVX2, avx2)
+ISA_VARIANT(ISA_TARGET_AVX512, avx512)
+#endif
+
+const CpuKernels& getCpuKernels()
+{
+    switch (getCpuIsa())
+    {
+#if CPU_DISPATCH_X86
+    case ISA_AVX512:    return g_kernels_avx512;
+    case ISA_AVX2:      return g_kernels_avx2;
+    case ISA_SSE42:     return g_kernels_sse42;
+#endif
+    default:            return g_kernels_default;
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef CPUDISPATCH_H
+#define CPUDISPATCH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Runtime CPU dispatch for the hot loops of the viewer and the search.
+ *
+ * The release build targets the baseline instruction set of the host
+ * architecture. The loops below are compiled once more for each of the
+ * supported x86 extensions and the best variant for the running CPU is
+ * selected the first time any of them is requested.
+ */
+
+enum CpuIsa
+{
+    ISA_DEFAULT,
+    ISA_SSE42,
+    ISA_AVX2,
+    ISA_AVX512,
+};
+
+// highest supported instruction set level (detected once)
+int getCpuIsa();
+const char *getCpuIsaName(int isa);
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CPU_DISPATCH_X86        1
+#define ISA_TARGET_SSE42        __attribute__((target("sse4.2")))
+#define ISA_TARGET_AVX2         __attribute__((target("avx2")))
+#define ISA_TARGET_AVX512       __attribute__((target("avx512f,avx512bw")))
+#define ISA_INLINE              inline __attribute__((always_inline))
+#else
+#define CPU_DISPATCH_X86        0
+#define ISA_INLINE              inline
+#endif
+
+// seed offset of a slime chunk, using the int arithmetic of Java
+static inline uint64_t slimeOffset(int x, int z)
+{
+    int64_t off = 0;
+    off += (int32_t)((uint32_t)x * (uint32_t)x * 0x4c1906U);
+    off += (int32_t)((uint32_t)x * 0x5ac0dbU);
+    off += (int64_t)(int32_t)((uint32_t)z * (uint32_t)z) * 0x4307a7LL;
+    off += (int32_t)((uint32_t)z * 0x5f24fU);
+    return (uint64_t) off;
+}
+
+struct CpuKernels
+{
+    // gray scale of a climate parameter map
+    void (*climateToGray)(unsigned char *rgb, const int *para, int n,
+        int cmin, int cmax);
+
+    // Shade an image of w*h pixels from a height map that has a border of
+    // one pixel, i.e. (w+2)*(h+2) samples.
+    void (*shadeHeight)(unsigned char *rgb, const float *height, int w, int h,
+        bool gray, bool shading, bool contours, float mul, float ymax);
+
+    // Slime chunk map of w*h chunks, one byte per chunk, rows of 'stride'
+    // bytes apart.
+    void (*mapSlime)(unsigned char *out, int stride, uint64_t seed,
+        int x, int z, int w, int h);
+
+    // out[i] = (in[i] + add) mod 2^48
+    void (*offsetSeeds)(uint64_t *out, const uint64_t *in, size_t n, uint64_t add);
+};
+
+const CpuKernels& getCpuKernels();
+
+#endif // CPUDISPATCH_H
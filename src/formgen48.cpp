@@ -4,6 +4,7 @@
 #include "mainwindow.h"
 #include "message.h"
 #include "search.h"
+#include "seedlist.h"
 #include "seedtables.h"
 #include "util.h"
 
@@ -99,14 +100,8 @@ bool FormGen48::setList48(QString path, bool quiet)
         slist48path = path;
         parent->prevdir = finfo.absolutePath();
 
-        uint64_t *l = NULL;
-        uint64_t len;
-        QByteArray ba = path.toLocal8Bit();
-        l = loadSavedSeeds(ba.data(), &len);
-        if (l != NULL)
+        if (loadSeedList(path, slist48))
         {
-            slist48.assign(l, l+len);
-            free(l);
             ok = true;
         }
         else if (!quiet)
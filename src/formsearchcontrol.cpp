@@ -3,8 +3,10 @@
 
 #include "mainwindow.h"
 #include "message.h"
+#include "profiledialog.h"
 #include "rangedialog.h"
 #include "search.h"
+#include "seedlist.h"
 #include "util.h"
 
 #include <QAction>
@@ -12,6 +14,7 @@
 #include <QFileDialog>
 #include <QFontMetrics>
 #include <QMenu>
+#include <QProgressDialog>
 
 
 QVariant SeedTableModel::data(const QModelIndex& index, int role) const
@@ -107,10 +110,13 @@ FormSearchControl::FormSearchControl(MainWindow *parent)
     , sthread(this)
     , elapsed()
     , stimer()
+    , prepdialog()
+    , preparing()
     , resultfile()
     , slist64path()
     , slist64fnam()
     , slist64()
+    , listidx(~(uint64_t)0)
     , smin(0)
     , smax(~(uint64_t)0)
     , qbuf()
@@ -135,8 +141,9 @@ FormSearchControl::FormSearchControl(MainWindow *parent)
     connect(ui->results->horizontalHeader(), &QHeaderView::sortIndicatorChanged, this, &FormSearchControl::onSort);
     ui->results->sortByColumn(-1, Qt::AscendingOrder);
 
-    connect(&sthread, &SearchMaster::searchResult, this, &FormSearchControl::searchResult, Qt::QueuedConnection);
+    connect(&sthread, &SearchMaster::searchResults, this, &FormSearchControl::searchResults, Qt::QueuedConnection);
     connect(&sthread, &SearchMaster::searchFinish, this, &FormSearchControl::searchFinish, Qt::QueuedConnection);
+    connect(&sthread, &SearchMaster::searchPrepare, this, &FormSearchControl::searchPrepare, Qt::DirectConnection);
 
     connect(&stimer, &QTimer::timeout, this, QOverload<>::of(&FormSearchControl::progressTimeout));
 
@@ -189,6 +196,8 @@ SearchConfig FormSearchControl::getSearchConfig()
     s.threads = ui->spinThreads->value();
     s.slist64path = slist64path;
     s.startseed = ui->lineStart->text().toLongLong();
+    if (s.searchtype == SEARCH_LIST)
+        s.startidx = listidx;
     s.stoponres = ui->checkStop->isChecked();
     s.smin = smin;
     s.smax = smax;
@@ -221,12 +230,18 @@ bool FormSearchControl::setSearchConfig(SearchConfig s, bool quiet)
 #endif
 
     ui->lineStart->setText(QString::asprintf("%" PRId64, (int64_t)s.startseed));
+    listidx = s.startidx;
 
     return ok;
 }
 
 void FormSearchControl::stopSearch()
 {
+    if (preparing)
+    {   // abort the preparation, the search is torn down once it returns
+        sthread.stop = true;
+        return;
+    }
     sthread.stopSearch();
     onBufferTimeout();
 }
@@ -239,15 +254,10 @@ bool FormSearchControl::setList64(QString path, bool quiet)
         parent->prevdir = finfo.absolutePath();
         slist64fnam = finfo.fileName();
         slist64path = path;
-        uint64_t *l = NULL;
-        uint64_t len;
-        QByteArray ba = path.toLocal8Bit();
-        l = loadSavedSeeds(ba.data(), &len);
-        if (l != NULL)
+        if (loadSeedList(path, slist64))
         {
-            slist64.assign(l, l+len);
-            updateSearchProgress(0, len, l[0]);
-            free(l);
+            if (!slist64.empty())
+                updateSearchProgress(0, slist64.size(), slist64[0]);
             return true;
         }
         else if (!quiet)
@@ -352,10 +362,14 @@ void FormSearchControl::on_buttonClear_clicked()
     model->reset();
     searchProgressReset();
     ui->lineStart->setText("0");
+    listidx = ~(uint64_t)0;
 }
 
 void FormSearchControl::on_buttonStart_clicked()
 {
+    if (preparing)
+        return; // (the progress dialog aborts the preparation)
+
     if (ui->buttonStart->isChecked())
     {
         Session session;
@@ -385,6 +399,8 @@ void FormSearchControl::on_buttonStart_clicked()
             else
                 session.slist.clear();
 
+            sthread.sortmem = (uint64_t) parent->config.sortMemory << 20;
+            sthread.cachedir = getCandidateDir();
             ok = sthread.set(parent, session);
         }
 
@@ -403,7 +419,17 @@ void FormSearchControl::on_buttonStart_clicked()
             searchLockUi(true);
             nextupdate = 0;
             updt = 20;
+            // the controls stay disabled while the candidates are prepared
+            preparing = true;
+            ui->buttonStart->setEnabled(false);
             sthread.startSearch();
+            preparing = false;
+            ui->buttonStart->setEnabled(true);
+            if (prepdialog)
+            {
+                delete prepdialog;
+                prepdialog = nullptr;
+            }
             elapsed.start();
             stimer.start(250);
         }
@@ -453,6 +479,12 @@ void FormSearchControl::on_buttonMore_clicked()
     }
 }
 
+void FormSearchControl::on_buttonProfile_clicked()
+{
+    ProfileDialog *dialog = new ProfileDialog(this, &sthread);
+    dialog->show();
+}
+
 void FormSearchControl::onSeedSelectionChanged()
 {
     uint64_t s;
@@ -588,17 +620,23 @@ void FormSearchControl::onSort(int, Qt::SortOrder)
     }
 }
 
-void FormSearchControl::searchResult(uint64_t seed)
+void FormSearchControl::searchResults(QVector<uint64_t> seeds)
 {
     if (resultfile.isOpen())
     {
-        char s[32];
-        snprintf(s, sizeof(s), "%" PRId64 "\n", seed);
-        resultfile.write(s);
+        QByteArray ba;
+        ba.reserve(seeds.size() * 21);
+        for (uint64_t seed : qAsConst(seeds))
+        {
+            char s[32];
+            int n = snprintf(s, sizeof(s), "%" PRId64 "\n", seed);
+            ba.append(s, n);
+        }
+        resultfile.write(ba);
         resultfile.flush();
     }
 
-    qbuf.push_back(seed);
+    qbuf.insert(qbuf.end(), seeds.begin(), seeds.end());
     if (ui->checkStop->isChecked())
     {
         searchResultsAdd(qbuf, false);
@@ -739,6 +777,7 @@ void FormSearchControl::searchProgressReset()
 void FormSearchControl::updateSearchProgress(uint64_t prog, uint64_t end, int64_t seed)
 {
     ui->lineStart->setText(QString::asprintf("%" PRId64, seed));
+    listidx = prog; // (the progress of a list search is the list index)
 
     if (!end)
         return;
@@ -771,6 +810,24 @@ void FormSearchControl::updateSearchProgress(uint64_t prog, uint64_t end, int64_
         parent->setProgressIndication(value);
 }
 
+void FormSearchControl::searchPrepare(double progress)
+{
+    // the candidates are prepared on this thread: the dialog is modal, so
+    // that it processes the events when it is updated
+    if (!prepdialog)
+    {
+        prepdialog = new QProgressDialog(
+            tr("Preparing the seed candidates..."), tr("Abort"), 0, 1000, this);
+        prepdialog->setWindowTitle(tr("Search"));
+        prepdialog->setWindowModality(Qt::WindowModal);
+        prepdialog->setMinimumDuration(500);
+        prepdialog->setAutoClose(false);
+        prepdialog->setAutoReset(false);
+        connect(prepdialog, &QProgressDialog::canceled, this, [=]() { sthread.stop = true; });
+    }
+    prepdialog->setValue((int) (progress * 1000));
+}
+
 void FormSearchControl::searchFinish(bool done)
 {
     stimer.stop();
@@ -779,6 +836,7 @@ void FormSearchControl::searchFinish(bool done)
     if (done)
     {
         ui->lineStart->setText(QString::asprintf("%" PRId64, sthread.smax));
+        listidx = sthread.scnt;
         ui->progressBar->setValue(10000);
         ui->progressBar->setFormat(tr("Done", "Progressbar"));
     }
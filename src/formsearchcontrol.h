@@ -20,6 +20,7 @@ class FormSearchControl;
 }
 
 class MainWindow;
+class QProgressDialog;
 
 class SeedTableModel : public QAbstractTableModel
 {
@@ -105,6 +106,9 @@ public:
     bool setSearchConfig(SearchConfig s, bool quiet);
 
     void stopSearch();
+    // Is the search preparing its candidates? (The event loop is then
+    // continued from within startSearch() by the progress dialog.)
+    bool isPreparing() const { return preparing; }
     bool setList64(QString path, bool quiet);
     bool setList64(QTextStream& stream);
 
@@ -127,6 +131,7 @@ public slots:
     void on_buttonClear_clicked();
     void on_buttonStart_clicked();
     void on_buttonMore_clicked();
+    void on_buttonProfile_clicked();
 
     void onSort(int column, Qt::SortOrder);
     void onSeedSelectionChanged();
@@ -140,11 +145,12 @@ public slots:
     void pasteResults();
     int pasteList(bool dummy);
     void onBufferTimeout();
-    void searchResult(uint64_t seed);
+    void searchResults(QVector<uint64_t> seeds);
     int searchResultsAdd(std::vector<uint64_t> seeds, bool countonly);
     void searchProgressReset();
     void updateSearchProgress(uint64_t last, uint64_t end, int64_t seed);
     void searchFinish(bool done);
+    void searchPrepare(double progress);
     void progressTimeout();
     void removeCurrent();
     void copySeed();
@@ -161,12 +167,15 @@ private:
     SearchMaster sthread;
     QElapsedTimer elapsed;
     QTimer stimer;
+    QProgressDialog *prepdialog; // progress of the candidate preparation
+    bool preparing; // startSearch() is still running
     QFile resultfile;
 
     // the seed list option is not stored in a widget but is loaded with the "..." button
     QString slist64path;
     QString slist64fnam; // file name without directory
     std::vector<uint64_t> slist64;
+    uint64_t listidx; // list index of the start seed (~0 if unknown)
 
     // min and max seeds values
     uint64_t smin, smax;
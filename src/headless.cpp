@@ -4,10 +4,14 @@
 #include "util.h"
 
 #include <QApplication>
+#include <QCryptographicHash>
 #include <QDateTime>
 #include <QFileInfo>
 #include <QStandardPaths>
 
+#include <algorithm>
+
+#include <signal.h>
 #include <stdio.h>
 
 #if defined(_WIN32)
@@ -37,28 +41,51 @@ static QTextStream& qOut()
     return out;
 }
 
-Headless::Headless(QString sessionpath, QString resultspath, bool reset, QObject *parent)
+// set by the handler of SIGINT and SIGTERM, and polled in the event loop
+static volatile sig_atomic_t g_signal = 0;
+
+static void onSignal(int sig)
+{
+    g_signal = sig;
+}
+
+Headless::Headless(QString sessionpath, QString resultspath, bool reset,
+        int shard, int shards, QString streampath, QObject *parent)
     : QThread(parent)
     , sthread(nullptr)
     , sessionpath(sessionpath)
     , resultfile(resultspath)
     , resultstream(stdout)
+    , journal()
+    , sfirst()
+    , slast()
+    , complete()
     , progressfp()
+    , profilepath()
 {
     sthread.isdone = true;
 
     QSettings settings(APP_STRING, APP_STRING);
     g_extgen.load(settings);
+    if (settings.contains("config/sortMemory"))
+        sthread.sortmem = (uint64_t) settings.value("config/sortMemory").toInt() << 20;
+    sthread.cachedir = getCandidateDir();
 
-    if (!loadSession(sessionpath, reset))
+    if (!loadSession(sessionpath, reset, streampath))
+        return;
+    if (!setShard(shard, shards))
         return;
 
     if (!sthread.set(nullptr, session))
         return;
+    complete = session.sc.done;
 
-    connect(&sthread, &SearchMaster::searchResult, this, &Headless::searchResult, Qt::QueuedConnection);
+    connect(&sthread, &SearchMaster::searchResults, this, &Headless::searchResults, Qt::QueuedConnection);
+    connect(&sthread, &SearchMaster::searchCheckpoint, this, &Headless::searchCheckpoint, Qt::QueuedConnection);
     connect(&sthread, &SearchMaster::searchFinish, this, &Headless::searchFinish, Qt::QueuedConnection);
     connect(&timer, &QTimer::timeout, this, QOverload<>::of(&Headless::progressTimeout));
+    connect(&sigtimer, &QTimer::timeout, this, &Headless::signalTimeout);
+    connect(&sthread, &SearchMaster::searchPrepare, this, &Headless::searchPrepare, Qt::DirectConnection);
 
     if (!resultfile.fileName().isEmpty())
     {
@@ -67,26 +94,62 @@ Headless::Headless(QString sessionpath, QString resultspath, bool reset, QObject
         else
             warn(nullptr, "Output file for results coult not be created - using stdout instead.");
     }
+    if (resultfile.isOpen() && !openJournal(reset))
+        sthread.isdone = true;
 }
 
 Headless::~Headless()
 {
 }
 
-static bool load_seeds(std::vector<uint64_t>& seeds, QString path)
+static bool load_seeds(Session *session, QString path)
+{
+    // binary lists are mapped instead of loaded
+    session->slist.clear();
+    session->slistfile.clear();
+    if (isBinarySeedList(path))
+        return session->slistfile.map(path);
+    return loadSeedList(path, session->slist);
+}
+
+bool loadSessionLists(Session *session)
 {
-    QByteArray ba = path.toLocal8Bit();
-    uint64_t len;
-    if (uint64_t *l = loadSavedSeeds(ba.data(), &len))
+    if (session->sc.searchtype == SEARCH_LIST && session->sc.liststream)
     {
-        seeds.assign(l, l+len);
-        free(l);
-        return true;
+        session->slist.clear();
+        session->slistfile.clear();
+        QString path = session->sc.slist64path;
+        if (path != "-" && !QFileInfo(path).isReadable())
+        {
+            warn(nullptr, QString("Failed to open 64-bit seed list:\n\"%1\"").arg(path));
+            return false;
+        }
     }
-    return false;
+    else if (session->sc.searchtype == SEARCH_LIST)
+    {
+        if (!load_seeds(session, session->sc.slist64path))
+        {
+            warn(nullptr, QString("Failed to load 64-bit seed list:\n\"%1\"").arg(session->sc.slist64path));
+            return false;
+        }
+    }
+    else if (session->gen48.mode == GEN48_LIST)
+    {
+        if (!load_seeds(session, session->gen48.slist48path))
+        {
+            warn(nullptr, QString("Failed to load 48-bit seed list:\n\"%1\"").arg(session->gen48.slist48path));
+            return false;
+        }
+    }
+    else
+    {
+        session->slist.clear();
+        session->slistfile.clear();
+    }
+    return true;
 }
 
-bool Headless::loadSession(QString sessionpath, bool reset)
+bool Headless::loadSession(QString sessionpath, bool reset, QString streampath)
 {
     qOut() << "Loading session: \"" << sessionpath << "\"\n";
     qOut().flush();
@@ -105,7 +168,11 @@ bool Headless::loadSession(QString sessionpath, bool reset)
     }
 
     if (reset)
+    {
         session.sc.startseed = 0;
+        session.sc.startidx = ~(uint64_t)0;
+        session.sc.done = false;
+    }
     else
         results = session.slist;
 
@@ -114,27 +181,125 @@ bool Headless::loadSession(QString sessionpath, bool reset)
         warn(nullptr, "Session defines no search constraints.");
         return false;
     }
-    if (session.sc.searchtype == SEARCH_LIST)
-    {
-        if (!load_seeds(session.slist, session.sc.slist64path))
-        {
-            warn(nullptr, QString("Failed to load 64-bit seed list:\n\"%1\"").arg(session.sc.slist64path));
-            return false;
-        }
+
+    if (!streampath.isEmpty())
+    {   // search the streamed list instead, the offset only carries over
+        // to the same list
+        SearchConfig& sc = session.sc;
+        if (sc.searchtype != SEARCH_LIST || !sc.liststream || sc.slist64path != streampath)
+            sc.startseed = 0;
+        sc.startidx = ~(uint64_t)0;
+        sc.done = false;
+        sc.searchtype = SEARCH_LIST;
+        sc.slist64path = streampath;
+        sc.liststream = true;
     }
+    return loadSessionLists(&session);
+}
+
+bool Headless::setShard(int shard, int shards)
+{
+    SearchConfig& sc = session.sc;
+    if (shards <= 1)
+        return true;
+    if (sc.searchtype == SEARCH_LIST && sc.liststream)
+    {   // the offsets of a stream are not known ahead to split it evenly
+        warn(nullptr, "A streamed seed list cannot be split into shards.");
+        return false;
+    }
+    if (sc.shards > 1 && (sc.shard != shard || sc.shards != shards))
+    {   // the progress of a shard does not carry over to another one
+        warn(nullptr, QString("Session belongs to shard %1/%2 of the search space.")
+            .arg(sc.shard).arg(sc.shards));
+        return false;
+    }
+    sc.shard = shard;
+    sc.shards = shards;
+    return true;
+}
+
+// Identity of a seed list file: its path, size and modification time.
+static QString getListId(const QString& path)
+{
+    if (path.isEmpty() || path == "-")
+        return path;
+    QFileInfo finfo(path);
+    return QString("%1 %2 %3").arg(finfo.absoluteFilePath()).arg(finfo.size())
+        .arg(finfo.lastModified().toMSecsSinceEpoch());
+}
+
+// The world and candidate settings, and the search type and range of a
+// session (without its conditions or the identity of its seed list).
+static QString getSearchSpec(const Session& session)
+{
+    QString spec;
+    QTextStream specstream(&spec);
+    WorldInfo wi = session.wi;
+    Gen48Config gen48 = session.gen48;
+    wi.write(specstream);
+    gen48.write(specstream);
+    specstream << session.sc.searchtype << " " << session.sc.smin << " " << session.sc.smax;
+    specstream.flush();
+    return spec;
+}
+
+QString getJournalKey(const Session& session, uint64_t first, uint64_t last)
+{
+    QCryptographicHash hash(QCryptographicHash::Md5);
+    for (const Condition& c : session.cv)
+        hash.addData(c.toHex().toLatin1());
+    QString spec = getSearchSpec(session);
+    // the positions of a list search only tell the size of the list
+    if (session.sc.searchtype == SEARCH_LIST)
+        spec += " " + getListId(session.sc.slist64path);
     else if (session.gen48.mode == GEN48_LIST)
+        spec += " " + getListId(session.gen48.slist48path);
+    hash.addData(spec.toLatin1());
+    return QString("%1 %2 %3").arg(QString(hash.result().toHex())).arg(first).arg(last);
+}
+
+bool Headless::openJournal(bool reset)
+{
+    // map the search space as the search will, to find the resume point
+    sthread.preSearch();
+    bool empty = sthread.isdone;
+    uint64_t start = sthread.prog;
+    sfirst = sthread.sbegin;
+    slast = sthread.sfull ? sthread.send : sthread.send - 1;
+
+    QString jpath = QFileInfo(resultfile).absoluteFilePath() + ".journal";
+    if (reset)
+        QFile::remove(jpath);
+    if (!journal.open(jpath, getJournalKey(session, sfirst, slast)))
     {
-        if (!load_seeds(session.slist, session.gen48.slist48path))
-        {
-            warn(nullptr, QString("Failed to load 48-bit seed list:\n\"%1\"").arg(session.gen48.slist48path));
-            return false;
-        }
+        warn(nullptr, QString("Journal \"%1\" could not be opened or belongs to a different search.").arg(jpath));
+        return false;
     }
+    if (journal.done.empty() && journal.results.empty())
+    {   // a new journal takes over the progress and results of the session
+        if (!empty && start > sfirst)
+            journal.addRange(sfirst, start - 1);
+        for (uint64_t s : results)
+            journal.addResult(s);
+    }
+    journal.sync();
+    synctimer.start();
+    // the journal has the results of all of its completed ranges
+    results = journal.results;
+
+    // Completed items are logged out of order by the workers. The search
+    // resumes at the first gap, and the completed ranges above it are
+    // passed over.
+    uint64_t pos = sfirst;
+    if (empty || !journal.nextPending(&pos, slast))
+        complete = true;
     else
     {
-        session.slist.clear();
+        sthread.seed = sthread.seedAt(pos);
+        if (sthread.searchtype == SEARCH_LIST && !sthread.streaming)
+            sthread.idx = pos; // (the seed can appear more than once)
+        sthread.setCompleted(journal.done);
     }
-
     return true;
 }
 
@@ -144,7 +309,7 @@ void Headless::run()
     for (const Condition& cond : qAsConst(session.cv))
         qOut() << cond.summary(false) << "\n";
 
-    if (sthread.isdone)
+    if (sthread.isdone && !complete)
     {
         qOut() << "Search parameters invalid or incomplete.\n";
         qOut().flush();
@@ -152,6 +317,8 @@ void Headless::run()
         return;
     }
 
+    if (session.sc.shards > 1)
+        qOut() << "\nShard: " << session.sc.shard << "/" << session.sc.shards << "\n";
     qOut() << "\nSearching for seeds...\n\n";
     qOut().flush();
 
@@ -161,13 +328,18 @@ void Headless::run()
     if (resultfile.isOpen())
     {
         // open a separate write channel to the same result file and
-        // reserve space for a progress field after the header
+        // reserve space for a progress field after the header, followed by
+        // the condition plan (which has a fixed length for the session)
         QByteArray path = QFileInfo(resultfile).absoluteFilePath().toLocal8Bit();
         progressfp = fopen(path.data(), "rb+");
         if (progressfp)
         {
             fseek(progressfp, resultfile.size(), SEEK_SET);
             resultstream << QString::asprintf("#Progress: %20" PRId64 "\n", session.sc.startseed);
+            if (sthread.searchtype == SEARCH_LIST && !sthread.streaming)
+                resultstream << QString::asprintf("#ListIdx:  %20" PRIu64 "\n", session.sc.startidx);
+            resultstream << QString::asprintf("#Done:     %d\n", (int) complete);
+            resultstream << "#Plan:     " << sthread.getPlan() << "\n";
             resultstream.flush();
         }
 
@@ -177,22 +349,59 @@ void Headless::run()
             resultstream.flush();
         }
 
-        qOut() << "\n\n\n\n\n\n\n";
+        // reserve the lines of the progress display and condition profile
+        profilepath = QFileInfo(resultfile).absoluteFilePath() + ".profile";
+        qOut() << QString(7 + sthread.getProfile().size(), '\n');
         qOut().flush();
         timer.start(250);
     }
 
-    sthread.startSearch();
     elapsed.start();
+    if (complete)
+    {
+        searchFinish(true);
+        return;
+    }
+
+    // a termination request lets the workers complete their items, so the
+    // journal and the progress field are exact when the process exits
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    sigtimer.start(100);
+
+    sthread.startSearch();
 }
 
-void Headless::searchResult(uint64_t seed)
+void Headless::searchResults(QVector<uint64_t> seeds, QVector<uint64_t> pos)
 {
-    results.push_back(seed);
-    resultstream << (int64_t) seed << "\n";
+    for (int i = 0; i < seeds.size(); i++)
+    {
+        uint64_t seed = seeds[i];
+        if (journal.isOpen())
+            journal.addResult(seed, pos[i]);
+        results.push_back(seed);
+        resultstream << (int64_t) seed << "\n";
+    }
     resultstream.flush();
 }
 
+void Headless::searchCheckpoint(QVector<uint64_t> done)
+{
+    if (!journal.isOpen())
+        return;
+    for (int i = 0; i + 1 < done.size(); i += 2)
+        journal.addRange(done[i], done[i+1]);
+    if (synctimer.elapsed() >= SYNC_INTERVAL_MS)
+    {
+        journal.sync();
+        synctimer.start();
+    }
+    else
+    {
+        journal.flush();
+    }
+}
+
 void Headless::searchFinish(bool done)
 {
     if (timer.isActive())
@@ -200,18 +409,67 @@ void Headless::searchFinish(bool done)
         timer.stop();
         progressTimeout();
     }
+    writeProfile(sthread.getProfile());
     if (progressfp)
     {
         fclose(progressfp);
         progressfp = NULL;
     }
+    sigtimer.stop();
+    journal.sync();
     if (done)
         qOut() << "Search done!\n";
+    else if (draintimer.isValid())
+        qOut() << "Search stopped, the progress is saved.\n";
     qOut() << "Stopping event loop.\n";
     qOut().flush();
     emit finished();
 }
 
+void Headless::searchPrepare(double progress)
+{
+    // (on stderr, as the results may go to stdout)
+    bool last = progress >= 1;
+    if (last ? !preptimer.isValid() : preptimer.isValid() && preptimer.elapsed() < 250)
+        return;
+    fprintf(stderr, "\rPreparing the seed candidates: %5.1f%%%s", 100 * progress, last ? "\n" : "");
+    fflush(stderr);
+    if (last)
+        preptimer.invalidate();
+    else
+        preptimer.start();
+}
+
+void Headless::writeProfile(const QStringList& prof)
+{
+    if (profilepath.isEmpty())
+        return;
+    QFile file(profilepath);
+    if (file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+    {
+        QTextStream stream(&file);
+        for (const QString& s : prof)
+            stream << s << "\n";
+    }
+    proftimer.start();
+}
+
+void Headless::signalTimeout()
+{
+    int sig = g_signal;
+    g_signal = 0;
+    if (sig && !draintimer.isValid())
+    {   // no new work items, the current ones complete as usual
+        sthread.drainSearch();
+        draintimer.start();
+    }
+    else if (sig || (draintimer.isValid() && draintimer.elapsed() >= DRAIN_TIMEOUT_MS))
+    {   // a second signal or a timeout abandons the remaining items, which
+        // are then redone on resume
+        sthread.stop = true;
+    }
+}
+
 void Headless::progressTimeout()
 {
     QString status;
@@ -221,11 +479,32 @@ void Headless::progressTimeout()
 
     if (progressfp)
     {
+        // with a journal, the progress is where a resumed search would start
+        uint64_t resume = seed;
+        uint64_t rpos = prog + sthread.sbegin;
+        uint64_t jpos = sfirst;
+        bool done = complete || sthread.isdone;
+        if (journal.isOpen())
+        {
+            bool pending = journal.nextPending(&jpos, slast);
+            resume = pending ? sthread.seedAt(jpos) : sthread.smax;
+            rpos = pending ? jpos : slast + 1;
+            done |= !pending;
+        }
+        QByteArray plan = sthread.getPlan().toLatin1();
         long pos = ftell(progressfp);
-        fprintf(progressfp, "#Progress: %20" PRId64 "\n", seed);
+        fprintf(progressfp, "#Progress: %20" PRId64 "\n", resume);
+        if (sthread.searchtype == SEARCH_LIST && !sthread.streaming)
+            fprintf(progressfp, "#ListIdx:  %20" PRIu64 "\n", rpos); // (position = index)
+        fprintf(progressfp, "#Done:     %d\n", (int) done);
+        fprintf(progressfp, "#Plan:     %s\n", plan.data());
         fseek(progressfp, pos, SEEK_SET);
     }
 
+    QStringList prof = sthread.getProfile();
+    if (!proftimer.isValid() || proftimer.elapsed() >= PROFILE_INTERVAL_MS)
+        writeProfile(prof);
+
     short width = get_term_width();
     if (width <= 24)
         return;
@@ -237,12 +516,17 @@ void Headless::progressTimeout()
 
     QStringList l;
     l += QString(" Found matching seeds:%1 ").arg(results.size(), width-23);
-    l += QString(" Scheduled seed:%1 ").arg((int64_t)seed, width-17);
+    if (sthread.streaming)
+        l += QString(" List offset:%1 ").arg((int64_t)seed, width-14);
+    else
+        l += QString(" Scheduled seed:%1 ").arg((int64_t)seed, width-17);
     l += QString(" Progress:%1 ").arg(QString("%1 / %2 : %3%").arg(prog).arg(end).arg(100*perc, 5, 'f', 2), width-11);
     l += QString(" [%1%2] ").arg("", cols, '#').arg("", width-cols-4, '-');
     l += QString(" %1").arg(status, 1-width);
     l += QString::asprintf(" %d:%02d:%02d", (int)(sec / 3600), (int)(sec / 60) % 60, (int)(sec % 60));
     l += "";
+    for (const QString& s : qAsConst(prof))
+        l += " " + s;
 
     qOut() << "\e[999D\e[" << l.size() << "A";
     for (QString& s : l)
@@ -254,3 +538,105 @@ void Headless::progressTimeout()
 }
 
 
+int mergeResults(const QStringList& paths, QString resultspath)
+{
+    Session merged;
+    QStringList conds;
+    QString spec;
+    enum { SHARD_MISSING, SHARD_INCOMPLETE, SHARD_DONE };
+    std::vector<int> shards;
+    std::vector<int64_t> seeds;
+
+    if (paths.empty())
+    {
+        warn(nullptr, "No result files to merge.");
+        return 1;
+    }
+
+    for (const QString& path : paths)
+    {
+        QFile file(path);
+        Session session;
+        if (!file.open(QFile::ReadOnly))
+        {
+            warn(nullptr, QString("Failed to open \"%1\".").arg(path));
+            return 1;
+        }
+        QTextStream stream(&file);
+        if (!session.load(nullptr, stream, true))
+        {
+            warn(nullptr, QString("Failed to load session \"%1\".").arg(path));
+            return 1;
+        }
+
+        QStringList c;
+        for (const Condition& cond : qAsConst(session.cv))
+            c += cond.toHex();
+        // the shards have to split the same search space
+        QString sp = getSearchSpec(session);
+        if (session.sc.searchtype == SEARCH_LIST)
+            sp += " " + session.sc.slist64path;
+        if (path == paths.first())
+        {
+            merged = session;
+            conds = c;
+            spec = sp;
+            shards.assign(session.sc.shards, SHARD_MISSING);
+        }
+        else if (c != conds || sp != spec || session.sc.shards != merged.sc.shards)
+        {
+            warn(nullptr, QString("Session \"%1\" is for a different search.").arg(path));
+            return 1;
+        }
+        if (session.sc.shard >= 0 && session.sc.shard < (int) shards.size())
+        {
+            int& st = shards[session.sc.shard];
+            if (st != SHARD_DONE)
+                st = session.sc.done ? SHARD_DONE : SHARD_INCOMPLETE;
+        }
+
+        for (uint64_t s : session.slist)
+            seeds.push_back((int64_t) s);
+    }
+
+    bool done = true;
+    for (size_t i = 0; i < shards.size(); i++)
+    {
+        if (shards[i] == SHARD_MISSING)
+            qOut() << "Missing results of shard " << i << "/" << shards.size() << "\n";
+        else if (shards[i] == SHARD_INCOMPLETE)
+            qOut() << "Shard " << i << "/" << shards.size() << " is incomplete\n";
+        done &= (shards[i] == SHARD_DONE);
+    }
+    if (!done)
+        qOut() << "The merged session is incomplete, a resumed search starts over.\n";
+    qOut().flush();
+
+    std::sort(seeds.begin(), seeds.end());
+    seeds.erase(std::unique(seeds.begin(), seeds.end()), seeds.end());
+
+    // The merged session covers the whole search space, which is done when
+    // all shards are. Otherwise a resumed search starts over, as the shards
+    // keep their own progress.
+    merged.sc.shard = 0;
+    merged.sc.shards = 1;
+    merged.sc.startseed = done ? merged.sc.smax : merged.sc.smin;
+    merged.sc.startidx = ~(uint64_t)0;
+    merged.sc.done = done;
+    merged.plan.clear();
+    merged.slist.assign(seeds.begin(), seeds.end());
+
+    QFile file(resultspath);
+    QTextStream stream(stdout);
+    if (!resultspath.isEmpty())
+    {
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text))
+        {
+            warn(nullptr, QString("Failed to create \"%1\".").arg(resultspath));
+            return 1;
+        }
+        stream.setDevice(&file);
+    }
+    merged.save(nullptr, stream);
+    return 0;
+}
@@ -1,6 +1,7 @@
 #ifndef HEADLESS_H
 #define HEADLESS_H
 
+#include "journal.h"
 #include "searchthread.h"
 #include <QThread>
 #include <QTimer>
@@ -12,30 +13,65 @@ class Headless : public QThread
     Q_OBJECT
 
 public:
-    Headless(QString sessionpath, QString resultspath, bool reset, QObject *parent = 0);
+    Headless(QString sessionpath, QString resultspath, bool reset,
+        int shard = 0, int shards = 1, QString streampath = QString(),
+        QObject *parent = 0);
     virtual ~Headless();
 
-    bool loadSession(QString sessionpath, bool reset);
+    bool loadSession(QString sessionpath, bool reset, QString streampath);
+    bool setShard(int shard, int shards);
+    bool openJournal(bool reset);
+    void writeProfile(const QStringList& prof);
 
 public slots:
     void run();
-    void searchResult(uint64_t seed);
+    void searchResults(QVector<uint64_t> seeds, QVector<uint64_t> pos);
+    void searchCheckpoint(QVector<uint64_t> done);
     void searchFinish(bool done);
+    void searchPrepare(double progress);
     void progressTimeout();
+    void signalTimeout();
 
 signals:
     void finished();
 
 public:
+    // interval at which the journal is committed to the storage device
+    enum { SYNC_INTERVAL_MS = 5000 };
+    // time the workers get to complete their items after SIGINT or SIGTERM
+    enum { DRAIN_TIMEOUT_MS = 10000 };
+    // interval at which the condition profile file is rewritten
+    enum { PROFILE_INTERVAL_MS = 5000 };
+
     SearchMaster sthread;
     QString sessionpath;
     Session session;
     std::vector<uint64_t> results;
+    SearchJournal journal;      // checkpoints next to the results
+    uint64_t sfirst, slast;     // progress positions of the search space
+    bool complete;              // the journal covers the whole search space
     QFile resultfile;
     QTextStream resultstream;
     FILE *progressfp;
+    QString profilepath; // condition profile next to the results
     QTimer timer;
     QElapsedTimer elapsed;
+    QElapsedTimer synctimer;
+    QTimer sigtimer;            // polls for termination signals
+    QElapsedTimer draintimer;   // time since the search is draining
+    QElapsedTimer preptimer;    // time since the preparation progress was shown
+    QElapsedTimer proftimer;    // time since the profile file was written
 };
 
+// Load the seed list that a session refers to, replacing its results.
+// (A streamed list is read by the search itself.)
+bool loadSessionLists(Session *session);
+
+// Key that identifies the search space [first, last] of a session in a journal.
+QString getJournalKey(const Session& session, uint64_t first, uint64_t last);
+
+// Merge the results of several session files (e.g. the shards of a search)
+// into one sorted set without duplicates. Returns a process exit code.
+int mergeResults(const QStringList& paths, QString resultspath);
+
 #endif // HEADLESS_H
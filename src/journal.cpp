@@ -0,0 +1,220 @@
+#include "journal.h"
+
+#include <QByteArray>
+
+#include <iterator>
+
+#include <inttypes.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+
+SearchJournal::SearchJournal()
+    : path()
+    , done()
+    , results()
+    , fp()
+{
+}
+
+SearchJournal::~SearchJournal()
+{
+    close();
+}
+
+bool SearchJournal::open(QString path, QString key)
+{
+    close();
+    done.clear();
+    results.clear();
+    this->path = path;
+
+    QByteArray ba = path.toLocal8Bit();
+    QByteArray head = ("#Journal: " + key).toLocal8Bit();
+    FILE *in = fopen(ba.data(), "r");
+    if (in)
+    {
+        char line[256];
+        bool ok = fgets(line, sizeof(line), in) &&
+            strncmp(line, head.data(), head.size()) == 0 &&
+            (line[head.size()] == '\n' || line[head.size()] == 0);
+        bool partial = false;
+        // the results are checked once all of the ranges are known
+        struct Result { uint64_t seed, pos; bool keep; };
+        std::vector<Result> pending;
+        uint64_t a, b;
+        while (ok && fgets(line, sizeof(line), in))
+        {
+            // an incomplete last line of a crashed run is ignored
+            if (!strchr(line, '\n'))
+            {
+                partial = true;
+                break;
+            }
+            if (sscanf(line, "D %" SCNu64 " %" SCNu64, &a, &b) == 2 && a <= b)
+                insertRange(a, b);
+            else if (sscanf(line, "R %" SCNu64 " %" SCNu64, &a, &b) == 2)
+                pending.push_back(Result{a, b, false});
+            else if (sscanf(line, "R %" SCNu64, &a) == 1)
+                pending.push_back(Result{a, 0, true});
+        }
+        fclose(in);
+        if (!ok)
+            return false;
+        std::vector<Result> kept;
+        for (const Result& r : pending)
+        {
+            if (r.keep || isDone(r.pos))
+                kept.push_back(r);
+        }
+        for (const Result& r : kept)
+            results.push_back(r.seed);
+
+        if (kept.size() < pending.size())
+        {   // The items of the dropped results are searched again, so the
+            // journal is rewritten without them, as they would otherwise
+            // count twice after the next resume.
+            QByteArray tmp = ba + ".tmp";
+            FILE *out = fopen(tmp.data(), "w");
+            if (!out)
+                return false;
+            fprintf(out, "%s\n", head.data());
+            for (const auto& d : done)
+                fprintf(out, "D %" PRIu64 " %" PRIu64 "\n", d.first, d.second);
+            for (const Result& r : kept)
+            {
+                if (r.keep)
+                    fprintf(out, "R %" PRIu64 "\n", r.seed);
+                else
+                    fprintf(out, "R %" PRIu64 " %" PRIu64 "\n", r.seed, r.pos);
+            }
+            bool written = fflush(out) == 0;
+#if defined(_WIN32)
+            written &= _commit(_fileno(out)) == 0;
+#else
+            written &= fsync(fileno(out)) == 0;
+#endif
+            written &= fclose(out) == 0;
+#if defined(_WIN32)
+            if (written)
+                remove(ba.data());
+#endif
+            if (!written || rename(tmp.data(), ba.data()) != 0)
+            {
+                remove(tmp.data());
+                return false;
+            }
+            partial = false;
+        }
+        fp = fopen(ba.data(), "a");
+        if (fp && partial)
+            fputc('\n', fp);
+    }
+    else
+    {
+        fp = fopen(ba.data(), "w");
+        if (fp)
+            fprintf(fp, "%s\n", head.data());
+    }
+    if (fp)
+        fflush(fp);
+    return fp != NULL;
+}
+
+void SearchJournal::close()
+{
+    if (fp)
+    {
+        fclose(fp);
+        fp = NULL;
+    }
+}
+
+void SearchJournal::insertRange(uint64_t first, uint64_t last)
+{
+    // merge with the overlapping and adjacent ranges
+    auto it = done.upper_bound(first);
+    if (it != done.begin())
+    {
+        auto prev = std::prev(it);
+        if (prev->second == ~(uint64_t)0 || prev->second + 1 >= first)
+        {
+            first = prev->first;
+            if (prev->second > last)
+                last = prev->second;
+            it = done.erase(prev);
+        }
+    }
+    while (it != done.end() && (last == ~(uint64_t)0 || it->first <= last + 1))
+    {
+        if (it->second > last)
+            last = it->second;
+        it = done.erase(it);
+    }
+    done[first] = last;
+}
+
+void SearchJournal::addRange(uint64_t first, uint64_t last)
+{
+    insertRange(first, last);
+    if (fp)
+        fprintf(fp, "D %" PRIu64 " %" PRIu64 "\n", first, last);
+}
+
+void SearchJournal::addResult(uint64_t seed)
+{
+    results.push_back(seed);
+    if (fp)
+        fprintf(fp, "R %" PRIu64 "\n", seed);
+}
+
+void SearchJournal::addResult(uint64_t seed, uint64_t pos)
+{
+    results.push_back(seed);
+    if (fp)
+        fprintf(fp, "R %" PRIu64 " %" PRIu64 "\n", seed, pos);
+}
+
+void SearchJournal::flush()
+{
+    if (fp)
+        fflush(fp);
+}
+
+void SearchJournal::sync()
+{
+    if (!fp)
+        return;
+    fflush(fp);
+#if defined(_WIN32)
+    _commit(_fileno(fp));
+#else
+    fsync(fileno(fp));
+#endif
+}
+
+bool SearchJournal::isDone(uint64_t pos) const
+{
+    auto it = done.upper_bound(pos);
+    if (it == done.begin())
+        return false;
+    return std::prev(it)->second >= pos;
+}
+
+bool SearchJournal::nextPending(uint64_t *pos, uint64_t last) const
+{
+    auto it = done.upper_bound(*pos);
+    if (it != done.begin() && std::prev(it)->second >= *pos)
+    {
+        uint64_t e = std::prev(it)->second;
+        if (e >= last)
+            return false;
+        *pos = e + 1;
+    }
+    return *pos <= last;
+}
@@ -0,0 +1,60 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <QString>
+
+#include <map>
+#include <vector>
+
+#include <stdint.h>
+#include <stdio.h>
+
+/* Append-only journal of a search: records the completed ranges of progress
+ * positions and the results, so that a search can be resumed exactly.
+ *
+ * Lines:
+ *  #Journal: <key>     identifies the search space
+ *  D <first> <last>    positions [first, last] are completed
+ *  R <seed> <pos>      a result of the item at position 'pos'
+ *  R <seed>            a result that is kept in any case
+ *
+ * A result only counts once the range of its item is completed, so the
+ * results of items that were interrupted are dropped when they are replayed
+ * (the items are searched again).
+ */
+class SearchJournal
+{
+public:
+    SearchJournal();
+    ~SearchJournal();
+
+    // Open the journal at 'path' and replay its entries. A journal of a
+    // different search (key mismatch) is not touched and fails to open.
+    bool open(QString path, QString key);
+    void close();
+    bool isOpen() const { return fp != NULL; }
+
+    void addRange(uint64_t first, uint64_t last);
+    void addResult(uint64_t seed);
+    void addResult(uint64_t seed, uint64_t pos);
+    void flush();
+    // Flush and commit the journal to the storage device.
+    void sync();
+
+    // Is the position in a completed range?
+    bool isDone(uint64_t pos) const;
+    // Advance 'pos' to the first position up to 'last' that is not completed.
+    // Returns false if there is none.
+    bool nextPending(uint64_t *pos, uint64_t last) const;
+
+    QString path;
+    std::map<uint64_t, uint64_t> done;  // merged completed ranges (first -> last)
+    std::vector<uint64_t> results;
+
+private:
+    void insertRange(uint64_t first, uint64_t last);
+
+    FILE *fp;
+};
+
+#endif // JOURNAL_H
@@ -1,6 +1,11 @@
 #include "aboutdialog.h"
+#include "cpudispatch.h"
 #include "headless.h"
 #include "mainwindow.h"
+#include "seedlist.h"
+#if WITH_COORDINATOR
+#include "coordinator.h"
+#endif
 
 #include "cubiomes/util.h"
 
@@ -10,20 +15,7 @@
 #include <QGuiApplication>
 #include <QStandardPaths>
 
-extern "C"
-int getStructureConfig_override(int stype, int mc, StructureConfig *sconf)
-{
-    if unlikely(mc == INT_MAX) // to check if override is enabled in cubiomes
-        mc = 0;
-    int ok = getStructureConfig(stype, mc, sconf);
-    if (ok && g_extgen.saltOverride)
-    {
-        uint64_t salt = g_extgen.salts[stype];
-        if (salt <= MASK48)
-            sconf->salt = salt;
-    }
-    return ok;
-}
+#include <inttypes.h>
 
 int main(int argc, char *argv[])
 {
@@ -37,8 +29,15 @@ int main(int argc, char *argv[])
     bool clear = false;
     bool reset = false;
     bool usage = false;
+    bool merge = false;
+    bool convert = false;
+    int shard = 0, shards = 1;
     QString sessionpath;
     QString resultspath;
+    QStringList files;
+    QString serveaddr;
+    QString connectaddr;
+    QString streampath;
 
     for (int i = 1; i < argc; i++)
     {
@@ -58,8 +57,29 @@ int main(int argc, char *argv[])
             resultspath = argv[i] + 6;
         else if (strncmp(argv[i], "--out", 5) == 0 && i+1 < argc)
             resultspath = argv[++i];
+        else if (strncmp(argv[i], "--shard=", 8) == 0)
+        {
+            if (sscanf(argv[i] + 8, "%d/%d", &shard, &shards) != 2 ||
+                shards < 1 || shard < 0 || shard >= shards)
+            {
+                fprintf(stderr, "Invalid shard \"%s\", expected i/N with 0 <= i < N.\n", argv[i] + 8);
+                exit(1);
+            }
+        }
+        else if (strncmp(argv[i], "--serve=", 8) == 0)
+            serveaddr = argv[i] + 8;
+        else if (strncmp(argv[i], "--connect=", 10) == 0)
+            connectaddr = argv[i] + 10;
+        else if (strncmp(argv[i], "--list=", 7) == 0)
+            streampath = argv[i] + 7;
+        else if (strcmp(argv[i], "--merge") == 0)
+            merge = true;
+        else if (strcmp(argv[i], "--convert-list") == 0)
+            convert = true;
         else if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0)
             usage = true;
+        else if (argv[i][0] != '-')
+            files += argv[i];
     }
 
     if (usage)
@@ -74,6 +94,21 @@ int main(int argc, char *argv[])
                 "      --reset-all            Clear settings and remove all session data.\n"
                 "      --session=file         Open this session file.\n"
                 "      --out=file             Write matching seeds to this file while searching.\n"
+                "      --shard=i/N            Search only the i-th of N equal parts of the search\n"
+                "                             space (0 <= i < N) in headless mode.\n"
+                "      --list=file            Search the 64-bit seeds of a text or binary list,\n"
+                "                             read as a stream from the file, or from stdin\n"
+                "                             with '-', in headless mode.\n"
+#if WITH_COORDINATOR
+                "      --serve=address        Coordinate a distributed search of the session in\n"
+                "                             headless mode: serve leases of the search space to\n"
+                "                             workers on host:port or on a local socket path.\n"
+                "      --connect=address      Run as a headless worker of a coordinator.\n"
+#endif
+                "      --merge files...       Merge the results of the given files, e.g. of the\n"
+                "                             shards of a search, and write them to --out.\n"
+                "      --convert-list file    Convert a text seed list to the binary format,\n"
+                "                             which is mapped into memory, and write it to --out.\n"
                 "\n";
         printf("%s", msg);
         exit(0);
@@ -81,6 +116,7 @@ int main(int argc, char *argv[])
     if (version)
     {
         printf("%s %s\n", APP_STRING, getVersStr().toLocal8Bit().data());
+        printf("CPU dispatch: %s\n", getCpuIsaName(getCpuIsa()));
         exit(0);
     }
 
@@ -106,10 +142,61 @@ int main(int argc, char *argv[])
         sessionpath = path + "/session.save";
     }
 
+    if (merge)
+    {
+        QCoreApplication app(argc, argv);
+        return mergeResults(files, resultspath);
+    }
+    if (convert)
+    {
+        if (files.size() != 1 || resultspath.isEmpty())
+        {
+            fprintf(stderr, "Usage: --convert-list <text list> --out=<binary list>\n");
+            return 1;
+        }
+        int64_t n = convertSeedList(files[0], resultspath);
+        if (n < 0)
+        {
+            fprintf(stderr, "Failed to convert \"%s\".\n", files[0].toLocal8Bit().data());
+            return 1;
+        }
+        printf("Converted %" PRId64 " seeds.\n", n);
+        return 0;
+    }
+
+#if WITH_COORDINATOR
+    if (!serveaddr.isEmpty())
+    {
+        QCoreApplication app(argc, argv);
+        Coordinator coordinator(sessionpath, resultspath, serveaddr, &app);
+
+        QObject::connect(&coordinator, SIGNAL(finished()), &app, SLOT(quit()));
+        QTimer::singleShot(0, &coordinator, SLOT(run()));
+
+        return app.exec();
+    }
+    if (!connectaddr.isEmpty())
+    {
+        QCoreApplication app(argc, argv);
+        LeaseWorker worker(connectaddr, &app);
+
+        QObject::connect(&worker, SIGNAL(finished()), &app, SLOT(quit()));
+        QTimer::singleShot(0, &worker, SLOT(run()));
+
+        return app.exec();
+    }
+#else
+    if (!serveaddr.isEmpty() || !connectaddr.isEmpty())
+    {
+        fprintf(stderr, "Distributed searches require a build with network support.\n");
+        return 1;
+    }
+#endif
+
     if (nogui)
     {
         QCoreApplication app(argc, argv);
-        Headless headless(sessionpath, resultspath, clear, &app);
+        Headless headless(sessionpath, resultspath, clear, shard, shards, streampath, &app);
 
         QObject::connect(&headless, SIGNAL(finished()), &app, SLOT(quit()));
         QTimer::singleShot(0, &headless, SLOT(run()));
@@ -309,6 +309,12 @@ MainWindow::~MainWindow()
 
 void MainWindow::closeEvent(QCloseEvent *event)
 {
+    if (formControl->isPreparing())
+    {   // the search is still being set up further down the stack
+        formControl->stopSearch();
+        event->ignore();
+        return;
+    }
     formControl->stopSearch();
     QThreadPool::globalInstance()->clear();
     saveSettings();
@@ -604,6 +610,9 @@ bool MainWindow::saveSession(QTextStream& stream)
 
 bool MainWindow::loadSession(QTextStream& stream, bool keepresults, bool quiet)
 {
+    if (formControl->isPreparing())
+        return false;
+
     Session session;
     // build current session before loading to keep unspecified values the same
     getSeed(&session.wi);
@@ -0,0 +1,84 @@
+#include "profiledialog.h"
+#include "ui_profiledialog.h"
+
+#include "searchthread.h"
+
+#include <QTreeWidgetItem>
+
+ProfileDialog::ProfileDialog(QWidget *parent, SearchMaster *sthread)
+    : QDialog(parent)
+    , ui(new Ui::ProfileDialog)
+    , sthread(sthread)
+    , timer()
+{
+    ui->setupUi(this);
+    setAttribute(Qt::WA_DeleteOnClose);
+
+    connect(&timer, &QTimer::timeout, this, &ProfileDialog::updateProfile);
+    updateProfile();
+    timer.start(1000);
+}
+
+ProfileDialog::~ProfileDialog()
+{
+    delete ui;
+}
+
+static QString fmtTime(double ns)
+{
+    if (ns >= 10e9)
+        return QString::asprintf("%.1f s", ns * 1e-9);
+    if (ns >= 10e6)
+        return QString::asprintf("%.1f ms", ns * 1e-6);
+    if (ns >= 10e3)
+        return QString::asprintf("%.1f us", ns * 1e-3);
+    return QString::asprintf("%.0f ns", ns);
+}
+
+void ProfileDialog::updateProfile()
+{
+    static const char *passnames[] = {
+        QT_TRANSLATE_NOOP("ProfileDialog", "fast 48-bit"),
+        QT_TRANSLATE_NOOP("ProfileDialog", "full 48-bit"),
+        QT_TRANSLATE_NOOP("ProfileDialog", "full 64-bit"),
+    };
+    std::vector<CondStats> stats[PASS_FULL_64+1];
+    sthread->getStats(stats);
+
+    QTreeWidget *tree = ui->treeProfile;
+    int row = 0;
+    for (const Condition& c : sthread->condtree.condvec)
+    {
+        if (c.save == 0)
+            continue;
+        for (int pass = PASS_FAST_48; pass <= PASS_FULL_64; pass++)
+        {
+            if (c.save >= (int) stats[pass].size())
+                continue;
+            const CondStats& cs = stats[pass][c.save];
+            if (cs.evals == 0)
+                continue;
+            // the times are sampled, the totals are extrapolated
+            double self = cs.timed ? cs.selfns / (double) cs.timed : 0;
+            double avg = cs.timed ? cs.ns / (double) cs.timed : 0;
+
+            QTreeWidgetItem *item = tree->topLevelItem(row++);
+            if (!item)
+                item = new QTreeWidgetItem(tree);
+            item->setText(COL_COND, c.summary(false));
+            item->setText(COL_PASS, tr(passnames[pass]));
+            item->setText(COL_EVALS, QString::number(cs.evals));
+            item->setText(COL_PASSED, QString::asprintf("%.2f%%", 100.0 * cs.passes / cs.evals));
+            item->setText(COL_MAYBE, QString::asprintf("%.2f%%", 100.0 * cs.maybes / cs.evals));
+            item->setText(COL_FAILED, QString::asprintf("%.2f%%", 100.0 * cs.fails / cs.evals));
+            item->setText(COL_SELF, fmtTime(self));
+            item->setText(COL_AVG, fmtTime(avg));
+            item->setText(COL_SELFTOTAL, fmtTime(self * cs.evals));
+            item->setText(COL_TOTAL, fmtTime(avg * cs.evals));
+            for (int col = COL_EVALS; col < COL_MAX; col++)
+                item->setTextAlignment(col, Qt::AlignRight | Qt::AlignVCenter);
+        }
+    }
+    while (tree->topLevelItemCount() > row)
+        delete tree->takeTopLevelItem(row);
+}
@@ -0,0 +1,34 @@
+#ifndef PROFILEDIALOG_H
+#define PROFILEDIALOG_H
+
+#include <QDialog>
+#include <QTimer>
+
+namespace Ui {
+class ProfileDialog;
+}
+struct SearchMaster;
+
+class ProfileDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    explicit ProfileDialog(QWidget *parent, SearchMaster *sthread);
+    ~ProfileDialog();
+
+    enum {
+        COL_COND, COL_PASS, COL_EVALS, COL_PASSED, COL_MAYBE, COL_FAILED,
+        COL_SELF, COL_AVG, COL_SELFTOTAL, COL_TOTAL, COL_MAX
+    };
+
+public slots:
+    void updateProfile();
+
+private:
+    Ui::ProfileDialog *ui;
+    SearchMaster *sthread;
+    QTimer timer;
+};
+
+#endif // PROFILEDIALOG_H
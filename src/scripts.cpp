@@ -12,6 +12,8 @@
 #include <QTextBlock>
 #include <QTextDocumentFragment>
 
+#include <climits>
+
 
 LuaOutput g_lua_output[100];
 
@@ -108,11 +110,20 @@ static int l_getBiomeAt(lua_State *L)
     }
     lua_Integer id = none;
     if (validPos(x, y, z))
-        id = getBiomeAt(&env->g, 1, x, y, z);
+        id = getBiomeAt(env->g, 1, x, y, z);
     lua_pushinteger(L, id);
     return 1;
 }
 
+static void pushPos(lua_State *L, Pos p)
+{
+    lua_createtable(L, 0, 2);
+    lua_pushinteger(L, p.x);
+    lua_setfield(L, -2, "x");
+    lua_pushinteger(L, p.z);
+    lua_setfield(L, -2, "z");
+}
+
 static int l_getStructures(lua_State *L)
 {
     lua_getglobal(L, "_cb_env");
@@ -168,16 +179,16 @@ static int l_getStructures(lua_State *L)
                 continue; // this region is not suitable
             if (pos.x < x0 || pos.x > x1 || pos.z < z0 || pos.z > z1)
                 continue; // structure is outside the specified area
-            if (!isViableStructurePos(styp, &env->g, pos.x, pos.z, 0))
+            if (!isViableStructurePos(styp, env->g, pos.x, pos.z, 0))
                 continue; // biomes are not viable
             if (styp == End_City)
             {   // end cities have a dedicated terrain checker
-                if (!isViableEndCityTerrain(&env->g, &env->sn, pos.x, pos.z))
+                if (!isViableEndCityTerrain(env->g, &env->sn, pos.x, pos.z))
                     continue;
             }
             else if (env->mc >= MC_1_18)
             {   // some structures in 1.18+ depend on the terrain
-                if (!isViableStructureTerrain(styp, &env->g, pos.x, pos.z))
+                if (!isViableStructureTerrain(styp, env->g, pos.x, pos.z))
                     continue;
             }
             inst.push_back(pos);
@@ -187,11 +198,40 @@ static int l_getStructures(lua_State *L)
     lua_createtable(L, inst.size(), 0);
     for (int i = 0, n = inst.size(); i < n; i++)
     {
-        lua_createtable(L, 0, 2);
-        lua_pushinteger(L, inst[i].x);
-        lua_setfield(L, -2, "x");
-        lua_pushinteger(L, inst[i].z);
-        lua_setfield(L, -2, "z");
+        pushPos(L, inst[i]);
+        lua_seti(L, -2, i+1);
+    }
+    return 1;
+}
+
+static int l_getSpawn(lua_State *L)
+{
+    lua_getglobal(L, "_cb_env");
+    SearchThreadEnv *env = (SearchThreadEnv*) lua_touserdata(L, -1);
+    lua_pop(L, 1);
+
+    pushPos(L, env->getSpawnPos());
+    return 1;
+}
+
+static int l_getStrongholds(lua_State *L)
+{
+    lua_getglobal(L, "_cb_env");
+    SearchThreadEnv *env = (SearchThreadEnv*) lua_touserdata(L, -1);
+    lua_pop(L, 1);
+
+    // optional maximum number of strongholds
+    lua_Integer cnt = luaL_optinteger(L, 1, INT_MAX);
+    int n = cnt < 0 ? 0 : (cnt > INT_MAX ? INT_MAX : (int) cnt);
+
+    // the strongholds are shared with the search conditions of this seed
+    const SearchThreadEnv::StrongholdEntry *sh;
+    lua_newtable(L);
+    for (int i = 0; i < n && (sh = env->getStronghold(i)); i++)
+    {
+        if (*env->stop)
+            break;
+        pushPos(L, sh->pos);
         lua_seti(L, -2, i+1);
     }
     return 1;
@@ -265,6 +305,10 @@ lua_State *loadScript(QString path, QString *err)
         lua_setglobal(L, "getBiomeAt");
         lua_pushcfunction(L, l_getStructures);
         lua_setglobal(L, "getStructures");
+        lua_pushcfunction(L, l_getSpawn);
+        lua_setglobal(L, "getSpawn");
+        lua_pushcfunction(L, l_getStrongholds);
+        lua_setglobal(L, "getStrongholds");
         ok = true;
     }
     while (0);
@@ -16,9 +16,26 @@
 #include <QThread>
 
 #include <algorithm>
+#include <chrono>
+#include <cmath>
 
 #define MULTIPLY_CHAR QChar(0xD7)
 
+extern "C"
+int getStructureConfig_override(int stype, int mc, StructureConfig *sconf)
+{
+    if unlikely(mc == INT_MAX) // to check if override is enabled in cubiomes
+        mc = 0;
+    int ok = getStructureConfig(stype, mc, sconf);
+    if (ok && g_extgen.saltOverride)
+    {
+        uint64_t salt = g_extgen.salts[stype];
+        if (salt <= MASK48)
+            sconf->salt = salt;
+    }
+    return ok;
+}
+
 QString Condition::summary(bool aligntab) const
 {
     const FilterInfo& ft = g_filterinfo.list[type];
@@ -245,22 +262,431 @@ QString ConditionTree::set(const std::vector<Condition>& cv, int mc)
         if (c.relative <= cmax)
             references[c.relative].push_back(c.save);
     }
+    compile(mc);
+    optimize(mc, NULL);
     return "";
 }
 
+void ConditionTree::optimize(int mc, const std::vector<CondStats> *stats)
+{
+    for (int pass = PASS_FAST_48; pass <= PASS_FULL_64; pass++)
+    {
+        std::vector<std::vector<char>> prev = plan[pass];
+        std::vector<double> ecost(condvec.size());
+        double cost, prob;
+
+        plan[pass] = references;
+        estimate(0, mc, pass, NULL, 0, ecost, &cost, &prob);
+        if (!stats)
+            continue;
+
+        // calibrate the static cost units with the measured times
+        const std::vector<CondStats>& cs = stats[pass];
+        double ns = 0, units = 0;
+        if (cs.size() == condvec.size())
+        {
+            for (size_t i = 1; i < cs.size(); i++)
+            {
+                if (cs[i].timed < STATS_MIN_TIMED)
+                    continue;
+                ns += cs[i].ns;
+                units += cs[i].timed * ecost[i];
+            }
+        }
+        if (ns <= 0 || units <= 0)
+        {   // nothing measured yet, keep the current plan
+            plan[pass] = prev;
+            continue;
+        }
+        estimate(0, mc, pass, cs.data(), units / ns, ecost, &cost, &prob);
+    }
+    link();
+}
+
+QString ConditionTree::planString() const
+{
+    QString s;
+    for (int pass = PASS_FAST_48; pass <= PASS_FULL_64; pass++)
+    {
+        if (pass != PASS_FAST_48)
+            s += " ";
+        for (const std::vector<char>& order : plan[pass])
+            for (char b : order)
+                s += QString::asprintf("%02d", b);
+    }
+    return s;
+}
+
+bool ConditionTree::readPlan(const QString& s)
+{
+    QStringList parts = s.trimmed().split(' ');
+    if (parts.size() != PASS_FULL_64+1)
+        return false;
+    std::vector<std::vector<char>> p[PASS_FULL_64+1];
+    for (int pass = PASS_FAST_48; pass <= PASS_FULL_64; pass++)
+    {
+        QByteArray ba = parts[pass].toLatin1();
+        int n = 0;
+        p[pass] = references;
+        for (std::vector<char>& order : p[pass])
+        {
+            for (char& b : order)
+            {
+                if (n + 2 > ba.size())
+                    return false;
+                b = ba.mid(n, 2).toInt();
+                n += 2;
+            }
+        }
+        if (n != ba.size())
+            return false;
+        // each order has to be a permutation of the references
+        for (size_t i = 0; i < references.size(); i++)
+        {
+            std::vector<char> a = p[pass][i], r = references[i];
+            std::sort(a.begin(), a.end());
+            std::sort(r.begin(), r.end());
+            if (a != r)
+                return false;
+        }
+    }
+    for (int pass = PASS_FAST_48; pass <= PASS_FULL_64; pass++)
+        plan[pass] = p[pass];
+    link();
+    return true;
+}
+
+void CondOp::set(const Condition& c, int mc)
+{
+    finfo = &g_filterinfo.list[c.type];
+    sconfok = 0;
+    memset(&sconf, 0, sizeof(sconf));
+    if (finfo->stype > 0)
+        sconfok = getStructureConfig_override(finfo->stype, mc, &sconf);
+    if (c.rmax > 0)
+    {
+        rad = c.rmax - 1;
+        rmaxsq = rad * (int64_t)rad + 1;
+    }
+    else
+    {
+        rad = -1;
+        rmaxsq = 0;
+    }
+}
+
+void ConditionTree::compile(int mc)
+{
+    prog.assign(condvec.size(), CondOp());
+    for (size_t i = 0; i < condvec.size(); i++)
+    {
+        const Condition& c = condvec[i];
+        CondOp& op = prog[i];
+        op.set(c, mc);
+        if (c.type == F_SPIRAL)
+            op.kind = CondOp::OP_SPIRAL;
+        else if (c.type == F_SCALE_TO_NETHER || c.type == F_SCALE_TO_OVERWORLD)
+            op.kind = CondOp::OP_SCALE;
+        else if (c.type == F_LOGIC_OR)
+            op.kind = CondOp::OP_OR;
+        else if (c.type == F_LOGIC_NOT)
+            op.kind = CondOp::OP_NOT;
+        else if (c.type == F_LUA)
+            op.kind = CondOp::OP_LUA;
+        else if (references[i].empty())
+            op.kind = CondOp::OP_LEAF;
+        else if (op.finfo->branch == FilterInfo::BR_NONE ||
+                (op.finfo->branch == FilterInfo::BR_CLUST && c.count != 1))
+            op.kind = CondOp::OP_CENTER;
+        else
+            op.kind = CondOp::OP_SPLIT;
+    }
+    link();
+}
+
+void ConditionTree::link()
+{
+    if (prog.size() != condvec.size())
+        return; // not compiled
+    progrefs.clear();
+    for (size_t i = 0; i < prog.size(); i++)
+    {
+        CondOp& op = prog[i];
+        op.broff = progrefs.size();
+        op.brcnt = references[i].size();
+        progrefs.insert(progrefs.end(), references[i].begin(), references[i].end());
+        op.andcnt = op.brcnt;
+        for (int pass = PASS_FAST_48; pass <= PASS_FULL_64; pass++)
+        {
+            op.andoff[pass] = progrefs.size();
+            if (plan[pass].size() == references.size())
+                progrefs.insert(progrefs.end(), plan[pass][i].begin(), plan[pass][i].end());
+            else
+                progrefs.insert(progrefs.end(), references[i].begin(), references[i].end());
+        }
+    }
+}
+
+// probability of at least 'n' events for a poisson distribution
+static double poissonTail(double lambda, int n)
+{
+    if (n <= 0)
+        return 1;
+    double term = exp(-lambda), cdf = 0;
+    for (int k = 0; k < n; k++)
+    {
+        cdf += term;
+        term *= lambda / (k + 1);
+    }
+    return cdf < 1 ? 1 - cdf : 0;
+}
+
+/* Static estimate of the cost and the pass probability of a single
+ * condition (without its branches). The cost is measured in units of
+ * about one structure position generation.
+ */
+static void estimateCond(const Condition& c, int mc, int pass, double *cost, double *prob)
+{
+    const FilterInfo& finfo = g_filterinfo.list[c.type];
+    double area;
+    if (c.rmax > 0)
+        area = M_PI * (c.rmax - 1) * (c.rmax - 1) + 1;
+    else
+        area = (c.x2 - (double)c.x1 + 1) * (c.z2 - (double)c.z1 + 1);
+    if (area < 1)
+        area = 1;
+
+    // conditions that cannot be decided in this pass only return a "maybe"
+    bool decided = (pass == PASS_FULL_64) || (pass == PASS_FULL_48 && !finfo.dep64);
+
+    *cost = 0;
+    *prob = 1;
+
+    switch (c.type)
+    {
+    case F_QH_IDEAL:
+    case F_QH_CLASSIC:
+    case F_QH_NORMAL:
+    case F_QH_BARELY:
+    case F_QM_95:
+    case F_QM_90:
+        *cost = 2 * (area / (512.0*512.0) + 1);
+        *prob = 1e-4 * (area / (512.0*512.0) + 1);
+        break;
+
+    case F_SLIME:
+        *cost = 0.2 * (area / 256 + 1);
+        if (c.count <= 0)
+            *prob = exp(-0.1 * area / 256);
+        else
+            *prob = poissonTail(0.1 * area / 256, c.count);
+        break;
+
+    case F_MINESHAFT:
+        *cost = 0.5 * (area / 256 + 1);
+        *prob = poissonTail(0.004 * area / 256, c.count);
+        break;
+
+    case F_FIRST_STRONGHOLD:
+        *cost = 1;
+        *prob = 0.3;
+        break;
+
+    case F_STRONGHOLD:
+        *cost = decided ? 2000 : 2;
+        *prob = 0.3;
+        break;
+
+    case F_SPAWN:
+        *cost = decided ? 5000 : 0.1;
+        *prob = decided ? 0.3 : 1;
+        break;
+
+    case F_HEIGHT:
+        *cost = decided ? 200 : 0.1;
+        *prob = decided ? 0.5 : 1;
+        break;
+
+    default:
+        if (finfo.cat == CAT_STRUCT)
+        {
+            StructureConfig sconf;
+            if (!getStructureConfig_override(finfo.stype, mc, &sconf))
+            {
+                *cost = 0.1;
+                *prob = 0;
+                break;
+            }
+            double rsiz = sconf.regionSize * 16.0;
+            double regions = (area / (rsiz * rsiz) + 1);
+            double lambda = area / (rsiz * rsiz);
+            *cost = regions;
+            if (decided)
+            {   // positions inside the area are checked for biome viability
+                *cost += 30 * lambda;
+                lambda *= 0.3;
+            }
+            if (c.count <= 0)
+                *prob = exp(-lambda);
+            else
+                *prob = poissonTail(lambda, c.count);
+        }
+        else if (finfo.cat == CAT_BIOMES)
+        {
+            int scale = c.step ? c.step : finfo.grid;
+            if (scale < 1)
+                scale = 1;
+            double cells = area / ((double)scale * scale) + 1;
+            if (c.type == F_BIOME_SAMPLE || c.type == F_NOISE_SAMPLE)
+                cells = cells < 1000 ? cells : 1000;
+            if (!decided)
+            {
+                *cost = 0.1;
+                *prob = 1;
+            }
+            else
+            {
+                *cost = 50 + 2 * cells;
+                *prob = 0.5;
+            }
+        }
+        else if (finfo.cat == CAT_OTHER && decided)
+        {
+            *cost = 100;
+            *prob = 0.5;
+        }
+        break;
+    }
+}
+
+/* Estimates the cost and the pass probability of the subtree at a node for
+ * a search pass and sorts the branches that are combined via AND such that
+ * those with the lowest cost per rejection are evaluated first. The plan
+ * only applies to evaluations without a path, where the order does not
+ * change the outcome, only how soon a failing branch is found. (The reported
+ * positions of split instances depend on the order, so an evaluation that
+ * records a path keeps the user order, see evalStep().)
+ */
+void ConditionTree::estimate(int node, int mc, int pass, const CondStats *stats, double unit,
+                             std::vector<double>& ecost, double *cost, double *prob)
+{
+    const Condition& c = condvec[node];
+    const std::vector<char>& branches = references[c.save];
+    std::vector<char>& order = plan[pass][c.save];
+
+    int n = branches.size();
+    std::vector<double> bcost(n), bprob(n);
+    for (int i = 0; i < n; i++)
+    {
+        int b = branches[i];
+        estimate(b, mc, pass, stats, unit, ecost, &bcost[i], &bprob[i]);
+        if (stats && stats[b].timed >= STATS_MIN_TIMED && stats[b].evals)
+        {   // use the measured cost and pass rate of the branch
+            bcost[i] = stats[b].ns * unit / stats[b].timed;
+            bprob[i] = 1 - stats[b].fails / (double) stats[b].evals;
+        }
+    }
+
+    if (c.type == F_LOGIC_OR || c.type == F_LOGIC_NOT)
+    {   // the first decisive branch determines the reported path
+        double cc = 0, pfail = 1;
+        for (int i = 0; i < n; i++)
+        {
+            cc += bcost[i] * pfail;
+            pfail *= 1 - bprob[i];
+        }
+        *cost = ecost[node] = cc;
+        if (n == 0)
+            *prob = c.type == F_LOGIC_OR ? 1 : 0;
+        else
+            *prob = c.type == F_LOGIC_OR ? 1 - pfail : 1 - bprob[0];
+        return;
+    }
+
+    // sort AND siblings by cost per rejection (stable for ties)
+    std::vector<int> idx(n);
+    for (int i = 0; i < n; i++)
+        idx[i] = i;
+    std::stable_sort(idx.begin(), idx.end(), [&](int a, int b) {
+        double ra = bprob[a] < 1 ? bcost[a] / (1 - bprob[a]) : INFINITY;
+        double rb = bprob[b] < 1 ? bcost[b] / (1 - bprob[b]) : INFINITY;
+        return ra < rb;
+    });
+    double cc = 0, pp = 1;
+    for (int i = 0; i < n; i++)
+    {
+        order[i] = branches[idx[i]];
+        cc += bcost[idx[i]] * pp;
+        pp *= bprob[idx[i]];
+    }
+
+    double ccond = 0, pcond = 1;
+    if (c.type != F_SELECT)
+        estimateCond(c, mc, pass, &ccond, &pcond);
+
+    const FilterInfo& finfo = g_filterinfo.list[c.type];
+    if (c.type == F_LUA)
+    {   // the script is only run when the branches have not failed
+        *cost = cc + pp * 1000;
+        *prob = pp * 0.5;
+    }
+    else if (c.type == F_SPIRAL)
+    {
+        int step = c.step ? c.step : 512;
+        double area;
+        if (c.rmax > 0)
+            area = M_PI * (c.rmax - 1) * (c.rmax - 1) + 1;
+        else
+            area = (c.x2 - (double)c.x1 + 1) * (c.z2 - (double)c.z1 + 1);
+        double steps = area / ((double)step * step) + 1;
+        // the iteration ends at the first position that satisfies the branches
+        double tries = pp > 0 && 1 / pp < steps ? 1 / pp : steps;
+        *cost = cc * tries;
+        *prob = 1 - pow(1 - pp, steps);
+    }
+    else if (n && (finfo.branch == FilterInfo::BR_SPLIT ||
+             (finfo.branch == FilterInfo::BR_CLUST && c.count == 1)))
+    {   // the branches are examined for each instance
+        double inst = c.count > 1 ? c.count : 1;
+        *cost = ccond + pcond * cc * inst;
+        *prob = pcond * (1 - pow(1 - pp, inst));
+    }
+    else
+    {
+        *cost = ccond + pcond * cc;
+        *prob = pcond * pp;
+    }
+    ecost[node] = *cost;
+}
+
 SearchThreadEnv::SearchThreadEnv()
 : condtree()
+, g()
 , mc()
 , large()
 , seed()
 , surfdim(DIM_UNDEF)
-, octaves()
 , searchpass(PASS_FAST_48)
 , stop()
+, scache()
+, pgen()
+, vgen()
+, shlist()
+, shfirst()
+, shdone()
+, shgen()
+, spawn()
+, spawngen()
+, ncache()
 , l_states()
+, l_nodes()
+, posbuf()
+, evalstack()
 {
-    memset(&g, 0, sizeof(g));
+    memset(gen, 0, sizeof(gen));
+    g = getGen(DIM_OVERWORLD);
     memset(&sn, 0, sizeof(sn));
+    memset(&shiter, 0, sizeof(shiter));
 }
 
 SearchThreadEnv::~SearchThreadEnv()
@@ -272,15 +698,44 @@ SearchThreadEnv::~SearchThreadEnv()
 QString SearchThreadEnv::init(int mc, bool large, const ConditionTree& condtree)
 {
     this->condtree = condtree;
+    for (std::vector<CondStats>& v : stats)
+        v.assign(condtree.condvec.size(), CondStats());
     this->mc = mc;
     this->large = large;
     this->seed = 0;
     this->surfdim = DIM_UNDEF;
-    this->octaves = 0;
+    this->scache.assign(STRUCT_CACHE_SIZE, StructEntry());
+    this->pgen = this->vgen = 1;
+    this->shgen = this->spawngen = 0;
     uint32_t flags = 0;
     if (large)
         flags |= LARGE_BIOMES;
-    setupGenerator(&g, mc, flags);
+    for (Generator& dg : gen)
+        setupGenerator(&dg, mc, flags);
+    g = getGen(DIM_OVERWORLD);
+
+    // the entries are allocated once, since the noise refers to its octaves
+    std::vector<std::pair<int,int>> noises;
+    for (const Condition& c: condtree.condvec)
+    {
+        if (c.type != F_CLIMATE_MINMAX && c.type != F_NOISE_SAMPLE)
+            continue;
+        if (c.para >= NP_MAX)
+            continue;
+        std::pair<int,int> np(c.para, c.octave <= 0 ? INT_MAX : c.octave);
+        if (std::find(noises.begin(), noises.end(), np) == noises.end())
+            noises.push_back(np);
+    }
+    noises.push_back(std::pair<int,int>(-1, 0));
+    this->ncache = std::vector<NoiseEntry>(noises.size());
+    for (size_t i = 0; i < noises.size(); i++)
+    {
+        NoiseEntry& e = ncache[i];
+        e.nptype = noises[i].first;
+        e.octaves = noises[i].second;
+        e.gen = 0;
+        initBiomeNoise(&e.bn, mc);
+    }
 
     QMap<uint64_t, QString> scripts;
     getScripts(scripts);
@@ -304,39 +759,131 @@ QString SearchThreadEnv::init(int mc, bool large, const ConditionTree& condtree)
         }
         l_states[c.hash] = L;
     }
+
+    size_t n = condtree.condvec.size();
+    l_nodes.assign(n, NULL);
+    for (size_t i = 0; i < n; i++)
+        if (condtree.condvec[i].type == F_LUA)
+            l_nodes[i] = l_states[condtree.condvec[i].hash];
+    posbuf.assign((n + 1) * MAX_INSTANCES, Pos());
+    evalstack.assign(n + 1, EvalFrame());
     return "";
 }
 
 void SearchThreadEnv::setSeed(uint64_t seed)
 {
+    // structure positions only depend on the lower 48 bits
+    bool move = ((seed ^ this->seed) & MASK48) != 0;
     this->seed = seed;
-    this->octaves = 0;
+    // the Nether and End surface noise only depend on the lower 48 bits
+    if (move || surfdim == DIM_OVERWORLD)
+        surfdim = DIM_UNDEF;
+    if (move)
+        pgen++;
+    if (++vgen == 0 || pgen == 0)
+    {   // generation counter wrapped, old entries could appear valid
+        scache.assign(STRUCT_CACHE_SIZE, StructEntry());
+        pgen = vgen = 1;
+        shgen = spawngen = 0;
+        for (NoiseEntry& e : ncache)
+            e.gen = 0;
+    }
+}
+
+SearchThreadEnv::StructEntry *SearchThreadEnv::getStructEntry(int stype, int rx, int rz)
+{
+    uint32_t h = (uint32_t) rx * 0x9E3779B1u + (uint32_t) rz * 0x85EBCA77u + (uint32_t) stype * 0xC2B2AE3Du;
+    StructEntry *e = &scache[(h ^ (h >> 16)) & (STRUCT_CACHE_SIZE - 1)];
+    if (e->pgen != pgen || e->stype != stype || e->rx != rx || e->rz != rz)
+    {
+        e->stype = stype;
+        e->rx = rx;
+        e->rz = rz;
+        e->pgen = pgen;
+        e->vgen = 0;
+        e->ok = getStructurePos(stype, mc, seed, rx, rz, &e->pos);
+    }
+    return e;
+}
+
+Pos SearchThreadEnv::getFirstStronghold()
+{
+    if (shgen != vgen)
+    {
+        shfirst = initFirstStronghold(&shiter, mc, seed);
+        shlist.clear();
+        shdone = false;
+        shgen = vgen;
+    }
+    return shfirst;
+}
+
+const SearchThreadEnv::StrongholdEntry *SearchThreadEnv::getStronghold(int i)
+{
+    getFirstStronghold();
+    while ((int) shlist.size() <= i && !shdone)
+    {   // extend the list by the next stronghold (which needs the biomes)
+        init4Dim(DIM_OVERWORLD);
+        StrongholdEntry e;
+        e.rem = nextStronghold(&shiter, g);
+        e.pos = shiter.pos;
+        e.ringnum = shiter.ringnum;
+        shlist.push_back(e);
+        if (e.rem <= 0)
+            shdone = true;
+    }
+    return i < (int) shlist.size() ? &shlist[i] : NULL;
+}
+
+Pos SearchThreadEnv::getSpawnPos()
+{
+    if (spawngen != vgen)
+    {
+        init4Dim(DIM_OVERWORLD);
+        spawn = getSpawn(g);
+        spawngen = vgen;
+    }
+    return spawn;
 }
 
 void SearchThreadEnv::init4Dim(int dim)
 {
+    g = getGen(dim);
     uint64_t mask = (dim == DIM_OVERWORLD ? ~0ULL : MASK48);
-    if (dim != g.dim || (seed & mask) != (g.seed & mask))
+    if (dim != g->dim || (seed & mask) != (g->seed & mask))
     {
-        applySeed(&g, dim, seed);
-        this->surfdim = DIM_UNDEF;
+        applySeed(g, dim, seed);
     }
-    else if (g.mc >= MC_1_15 && seed != g.seed)
+    else if (g->mc >= MC_1_15 && seed != g->seed)
     {
-        g.sha = getVoronoiSHA(seed);
+        g->sha = getVoronoiSHA(seed);
+        g->seed = seed;
     }
 }
 
-void SearchThreadEnv::init4Noise(int nptype, int octaves)
+DoublePerlinNoise *SearchThreadEnv::init4Noise(int nptype, int octaves)
 {
     if (octaves <= 0)
         octaves = INT_MAX;
-    if (g.bn.nptype == nptype && this->octaves == octaves)
-        return; // already initialized for parameter
-    if (seed == g.seed && g.bn.nptype == -1)
-        return; // fully initialized biome noise
-    setClimateParaSeed(&g.bn, seed, large, nptype, octaves);
-    this->octaves = octaves;
+    Generator *ow = getGen(DIM_OVERWORLD);
+    if (octaves == INT_MAX && seed == ow->seed && ow->dim == DIM_OVERWORLD && ow->bn.nptype == -1)
+        return &ow->bn.climate[nptype]; // fully initialized biome noise
+    NoiseEntry *e = &ncache.back(); // spare entry for other parameters
+    for (NoiseEntry& it : ncache)
+    {
+        if (it.nptype == nptype && it.octaves == octaves)
+        {
+            e = &it;
+            break;
+        }
+    }
+    if (e->gen == vgen && e->nptype == nptype && e->octaves == octaves)
+        return &e->bn.climate[nptype]; // already initialized for this seed
+    setClimateParaSeed(&e->bn, seed, large, nptype, octaves);
+    e->nptype = nptype;
+    e->octaves = octaves;
+    e->gen = vgen;
+    return &e->bn.climate[nptype];
 }
 
 void SearchThreadEnv::prepareSurfaceNoise(int dim)
@@ -348,327 +895,418 @@ void SearchThreadEnv::prepareSurfaceNoise(int dim)
     }
 }
 
-// The position buffers can exceed the stacksize on some platforms,
-// and dynamic heap allocation is too slow. So instead, we assign a
-// static memory region on the heap.
-static Pos* getPosBuf(uint32_t node)
+static int
+_testCondAt(
+    Pos                         at,             // relative origin
+    SearchThreadEnv           * env,            // thread-local environment
+    Pos                       * cent,           // output center position(s)
+    int                       * imax,           // max instances (NULL for avg)
+    const Condition           * cond,           // condition to check
+    const CondOp              & op              // compiled condition
+);
+
+// The tree is evaluated as a program without recursion: each condition gets
+// a frame on the stack of the environment, and a step of a frame either
+// finishes with a status or requests the evaluation of one of its branches,
+// which continues the frame with the status of that branch once it finishes.
+enum { EVAL_CALL = -1 };
+
+static inline int64_t evalClock()
 {
-#if DEBUG
-    if (node >= 100) return NULL; // fatal
-#endif
-    thread_local std::vector<Pos> buf(100 * MAX_INSTANCES);
-    return &buf[node * MAX_INSTANCES];
+    auto t = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(t).count();
 }
 
-static
-int _testTreeAt(
-    Pos                         at,             // relative origin
-    SearchThreadEnv           * env,            // thread-local environment
-    Pos                       * path,           // output center position(s)
-    int                         node
-)
+static inline int evalCall(EvalFrame *f, int node, Pos at, Pos *path)
 {
-    const ConditionTree *tree = &env->condtree;
-    const Condition& c = tree->condvec[node];
-    const std::vector<char>& branches = tree->references[c.save];
-    int st, br;
-    int rx1, rz1, rx2, rz2;
-    Pos pos;
-    Pos *inst = getPosBuf(node);
+    EvalFrame *next = f + 1;
+    next->node = node;
+    next->at = at;
+    next->path = path;
+    return EVAL_CALL;
+}
 
-    switch (c.type)
+static void spiralAdvance(EvalFrame *f)
+{
+    f->rx += f->dx;
+    f->rz += f->dz;
+    if (++f->i == f->dl)
     {
-    case F_SPIRAL:
+        f->i = 0;
+        int tmp = f->dx;
+        f->dx = -f->dz;
+        f->dz = tmp;
+        if (f->dz == 0)
+            f->dl++;
+    }
+}
 
-        st = COND_FAILED;
-        {   // run a spiral iterator over the rectangle
-            int step = c.step ? c.step : 512;
-            int rmax, x1, z1, x2, z2;
-            if (c.rmax > 0)
+// move the spiral iterator to the next position within the area
+static bool spiralFind(EvalFrame *f)
+{
+    while (true)
+    {
+        bool inx = (f->rx >= f->rx1 && f->rx <= f->rx2);
+        bool inz = (f->rz >= f->rz1 && f->rz <= f->rz2);
+        if (!inx && !inz)
+            return false;
+        if (inx && inz)
+        {
+            f->pos.x = f->rx * f->step;
+            f->pos.z = f->rz * f->step;
+
+            bool inr = true;
+            if (f->rmax)
             {
-                rmax = c.rmax - 1;
-                x1 = at.x - rmax;
-                z1 = at.z - rmax;
-                x2 = at.x + rmax;
-                z2 = at.z + rmax;
-                rmax = rmax * rmax + 1;
+                int dx = f->pos.x - f->at.x;
+                int dz = f->pos.z - f->at.z;
+                int64_t rsq = dx*(int64_t)dx + dz*(int64_t)dz;
+                inr = (rsq < f->rmax);
             }
-            else
+            else if (f->pos.x < f->x1 || f->pos.x > f->x2 || f->pos.z < f->z1 || f->pos.z > f->z2)
             {
-                rmax = 0;
-                x1 = c.x1 + at.x;
-                z1 = c.z1 + at.z;
-                x2 = c.x2 + at.x;
-                z2 = c.z2 + at.z;
+                inr = false;
             }
+            if (inr)
+                return true;
+        }
+        spiralAdvance(f);
+    }
+}
 
-            rx1 = floordiv(x1, step);
-            rz1 = floordiv(z1, step);
-            rx2 = floordiv(x2, step);
-            rz2 = floordiv(z2, step);
-
-            int rx = (rx1 + rx2) >> 1;
-            int rz = (rz1 + rz2) >> 1;
-            int i = 0, dl = 1;
-            int dx = 1, dz = 0;
-            while (true)
-            {
-                bool inx = (rx >= rx1 && rx <= rx2);
-                bool inz = (rz >= rz1 && rz <= rz2);
-                if (!inx && !inz)
-                    break;
-                if (inx && inz)
-                {
-                    pos.x = rx * step;
-                    pos.z = rz * step;
+// finish the branches at the current spiral position, true if the spiral is ok
+static bool spiralDone(EvalFrame *f, int save)
+{
+    if (f->sta == COND_MAYBE_POS_VALID)
+        f->sta = COND_MAYBE_POS_INVAL; // position moves => invalidate
+    if (f->sta > f->st)
+        f->st = f->sta;
+    if (f->path && f->st >= COND_MAYBE_POS_VALID)
+        f->path[save] = f->pos;
+    return f->st == COND_OK;
+}
 
-                    bool inr = true;
-                    if (rmax)
-                    {
-                        int dx = pos.x - at.x;
-                        int dz = pos.z - at.z;
-                        int64_t rsq = dx*(int64_t)dx + dz*(int64_t)dz;
-                        inr = (rsq < rmax);
-                    }
-                    else if (pos.x < x1 || pos.x > x2 || pos.z < z1 || pos.z > z2)
-                    {
-                        inr = false;
-                    }
+/* Continues the evaluation of a frame, either at its entry or with the status
+ * 'ret' of the branch that was last requested. Returns the status of the
+ * condition, or EVAL_CALL when the frame above is to be evaluated first.
+ */
+static int evalStep(SearchThreadEnv *env, EvalFrame *f, bool entry, int ret)
+{
+    const ConditionTree *tree = &env->condtree;
+    const CondOp& op = tree->prog[f->node];
+    const Condition& c = tree->condvec[f->node];
+    const int *branches = tree->progrefs.data() + op.broff;
+    // The planned order is only used without a path: which entries of an
+    // ambiguous split instance are left over from an earlier instance
+    // depends on the order, so the reported positions keep the user order.
+    const int *order = f->path ? branches : tree->progrefs.data() + op.andoff[env->searchpass];
+    Pos *inst = &env->posbuf[f->node * MAX_INSTANCES];
+
+    if (!entry && *env->stop)
+        return COND_FAILED;
 
-                    if (inr)
-                    {
-                        // children are combined via AND at the current position
-                        int sta = COND_OK;
-                        for (int b : branches)
-                        {
-                            int stb = _testTreeAt(pos, env, path, b);
-                            if (*env->stop)
-                                return COND_FAILED;
-                            if (stb < sta)
-                                sta = stb;
-                            if (sta == COND_FAILED)
-                                break;
-                        }
-                        if (sta == COND_MAYBE_POS_VALID )
-                            sta = COND_MAYBE_POS_INVAL; // position moves => invalidate
-                        if (sta > st)
-                            st = sta;
-                        if (path && st >= COND_MAYBE_POS_VALID)
-                            path[c.save] = pos;
-                        if (st == COND_OK)
-                            return COND_OK;
-                    }
-                }
-                rx += dx;
-                rz += dz;
-                if (++i == dl)
-                {
-                    i = 0;
-                    int tmp = dx;
-                    dx = -dz;
-                    dz = tmp;
-                    if (dz == 0)
-                        dl++;
-                }
+    switch (op.kind)
+    {
+    case CondOp::OP_SPIRAL:
+        if (entry)
+        {   // run a spiral iterator over the rectangle
+            f->step = c.step ? c.step : 512;
+            if (c.rmax > 0)
+            {
+                int rmax = c.rmax - 1;
+                f->x1 = f->at.x - rmax;
+                f->z1 = f->at.z - rmax;
+                f->x2 = f->at.x + rmax;
+                f->z2 = f->at.z + rmax;
+                f->rmax = rmax * rmax + 1;
+            }
+            else
+            {
+                f->rmax = 0;
+                f->x1 = c.x1 + f->at.x;
+                f->z1 = c.z1 + f->at.z;
+                f->x2 = c.x2 + f->at.x;
+                f->z2 = c.z2 + f->at.z;
             }
+            f->rx1 = floordiv(f->x1, f->step);
+            f->rz1 = floordiv(f->z1, f->step);
+            f->rx2 = floordiv(f->x2, f->step);
+            f->rz2 = floordiv(f->z2, f->step);
+            f->rx = (f->rx1 + f->rx2) >> 1;
+            f->rz = (f->rz1 + f->rz2) >> 1;
+            f->i = 0;
+            f->dl = 1;
+            f->dx = 1;
+            f->dz = 0;
+            f->st = COND_FAILED;
         }
-        return st;
-
-
-    case F_SCALE_TO_NETHER:
-        pos.x = at.x / 8;
-        pos.z = at.z / 8;
-        goto L_scaled_to_dim;
-    case F_SCALE_TO_OVERWORLD:
-        pos.x = at.x * 8;
-        pos.z = at.z * 8;
-        goto L_scaled_to_dim;
-
-    L_scaled_to_dim:
-        st = COND_OK;
-        for (int b : branches)
-        {
-            int sta = _testTreeAt(pos, env, path, b);
-            if (*env->stop)
-                return COND_FAILED;
-            if (sta < st)
-                st = sta;
-            if (st == COND_FAILED)
-                break;
+        else
+        {   // children are combined via AND at the current position
+            if (ret < f->sta)
+                f->sta = ret;
+            if (f->sta != COND_FAILED && ++f->ci < op.andcnt)
+                return evalCall(f, order[f->ci], f->pos, f->path);
+            if (spiralDone(f, c.save))
+                return COND_OK;
+            spiralAdvance(f);
         }
-        if (path && st >= COND_MAYBE_POS_VALID)
-            path[c.save] = pos;
-        return st;
-
-
-    case F_LOGIC_OR:
-        if (branches.empty())
+        while (spiralFind(f))
         {
-            if (path)
-                path[c.save].x = path[c.save].z = -1;
-            return COND_OK; // empty ORs are ignored
+            f->sta = COND_OK;
+            f->ci = 0;
+            if (op.andcnt > 0)
+                return evalCall(f, order[0], f->pos, f->path);
+            if (spiralDone(f, c.save))
+                return COND_OK;
+            spiralAdvance(f);
         }
-        else
+        return f->st;
+
+    case CondOp::OP_SCALE:
+    case CondOp::OP_CENTER:
+        if (entry)
         {
-            int b_ok = 0;
-            st = COND_FAILED;
-            for (int b : branches)
+            f->ci = 0;
+            if (c.type == F_SCALE_TO_NETHER)
             {
-                int sta = _testTreeAt(at, env, path, b);
-                if (*env->stop)
-                    return COND_FAILED;
-                if (sta > st)
-                    st = sta;
-                if (st >= COND_MAYBE_POS_VALID)
-                    b_ok = b;
-                if (st == COND_OK)
-                    break;
+                f->st = COND_OK;
+                f->pos.x = f->at.x / 8;
+                f->pos.z = f->at.z / 8;
             }
-            if (path && st >= COND_MAYBE_POS_VALID)
+            else if (c.type == F_SCALE_TO_OVERWORLD)
             {
-                path[c.save] = at;
-                for (int b : branches)
-                {   // invalidate the other branches
-                    if (b == b_ok)
-                        continue;
-                    Pos *p = path + tree->condvec[b].save;
-                    p->x = p->z = -1;
-                }
+                f->st = COND_OK;
+                f->pos.x = f->at.x * 8;
+                f->pos.z = f->at.z * 8;
+            }
+            else if (c.type == 0)
+            {   // this is the root condition
+                f->st = COND_OK;
+                f->pos = f->at;
+            }
+            else
+            {   // this condition cannot branch, position of multiple
+                // instances will be averaged to a center point
+                f->st = _testCondAt(f->at, env, &inst[0], NULL, &c, op);
+                if (f->st == COND_FAILED || f->st == COND_MAYBE_POS_INVAL)
+                    return f->st;
+                f->pos = inst[0]; // center point of instances
             }
         }
-        return st;
-
-
-    case F_LOGIC_NOT: //qDebug() << at.x << at.z;
-        if (branches.empty())
-            return COND_FAILED;
-        st = COND_OK;
-        for (int b : branches)
+        else
         {
-            int sta = _testTreeAt(at, env, path, b);
-            if (*env->stop)
-                return COND_FAILED;
-            if      (sta == COND_OK) { st = COND_FAILED; break; }
-            else if (sta == COND_FAILED) { st = COND_OK; break; }
-            else if (sta > st) st = sta;
+            if (ret < f->st)
+                f->st = ret;
+            f->ci++;
         }
-        return st;
-
-    case F_LUA:
-        st = COND_OK;
-        if (lua_State *L = env->l_states[c.hash])
+        if (f->st != COND_FAILED && f->ci < op.andcnt)
+            return evalCall(f, order[f->ci], f->pos, f->path);
+        if (f->path && f->st >= COND_MAYBE_POS_VALID)
+            f->path[c.save] = f->pos;
+        return f->st;
+
+    case CondOp::OP_SPLIT:
+        // check each instance individually, splitting the instances into
+        // independent subbranches that are combined via OR
+        if (entry)
         {
-            Pos *buf = path ? path : &inst[0];
-            for (int b : branches)
-            {
-                int sta = _testTreeAt(at, env, buf, b);
-                if (*env->stop)
-                    return COND_FAILED;
-                if (sta < st) {
-                    st = sta;
-                    if (st == COND_FAILED)
-                        return st;
-                }
+            f->n = MAX_INSTANCES;
+            f->st = _testCondAt(f->at, env, &inst[0], &f->n, &c, op);
+            if (f->st == COND_FAILED || f->st == COND_MAYBE_POS_INVAL)
+                return f->st;
+            f->sta = COND_FAILED;
+            f->iok = 0;
+            f->i = 0;
+        }
+        else
+        {   // worst branch dictates status for instance
+            if (ret < f->stb)
+                f->stb = ret;
+            if (f->stb != COND_FAILED && ++f->ci < op.andcnt)
+                return evalCall(f, order[f->ci], f->pos, f->path);
+            // best instance dictates status
+            if (f->stb > f->sta) {
+                f->sta = f->stb;
+                if (f->sta >= COND_MAYBE_POS_VALID)
+                    f->iok = f->i; // save position with ok path
             }
-            if (st <= COND_MAYBE_POS_INVAL)
-                return st;
-            int sta = runCheckScript(L, at, env, env->searchpass, buf, &c);
-            if (*env->stop)
-                return COND_FAILED;
-            if (sta < st)
-                st = sta;
+            f->i++;
         }
-        return st;
-
-    default:
-
-        if (branches.empty())
+        // continue until the status is as good as we need
+        while (f->sta < f->st && f->i < f->n)
+        {
+            f->stb = COND_OK;
+            f->ci = 0;
+            f->pos = inst[f->i];
+            if (op.andcnt > 0)
+                return evalCall(f, order[0], f->pos, f->path);
+            if (f->stb > f->sta) {
+                f->sta = f->stb;
+                if (f->sta >= COND_MAYBE_POS_VALID)
+                    f->iok = f->i;
+            }
+            f->i++;
+        }
+        // status cannot be better than it was for this condition
+        if (f->sta < f->st)
+            f->st = f->sta;
+        if (f->path && f->st >= COND_MAYBE_POS_VALID)
+            f->path[c.save] = inst[f->iok];
+        return f->st;
+
+    case CondOp::OP_LEAF:
         {   // this is a leaf node => check only for presence of instances
             int icnt = c.count;
-            st = testCondAt(at, env, &inst[0], &icnt, &c);
-            if (path && st >= COND_MAYBE_POS_VALID)
+            int st = _testCondAt(f->at, env, &inst[0], &icnt, &c, op);
+            if (f->path && st >= COND_MAYBE_POS_VALID)
             {
                 if (icnt == 1)
-                    path[c.save] = inst[0];
+                    f->path[c.save] = inst[0];
                 else if (icnt > 1 && st == COND_OK)
-                    path[c.save] = inst[0];
+                    f->path[c.save] = inst[0];
                 else
-                    path[c.save].x = path[c.save].z = -1;
+                    f->path[c.save].x = f->path[c.save].z = -1;
             }
             return st;
         }
 
-        br = g_filterinfo.list[c.type].branch;
-
-        if (br == FilterInfo::BR_NONE || (br == FilterInfo::BR_CLUST && c.count != 1))
-        {   // this condition cannot branch, position of multiple instances
-            // will be averaged to a center point
-            if (c.type == 0)
-            {   // this is the root condition
-                st = COND_OK;
-                pos = at;
+    case CondOp::OP_OR:
+        if (entry)
+        {
+            if (op.brcnt == 0)
+            {
+                if (f->path)
+                    f->path[c.save].x = f->path[c.save].z = -1;
+                return COND_OK; // empty ORs are ignored
             }
-            else
+            f->st = COND_FAILED;
+            f->iok = 0;
+            f->ci = 0;
+            return evalCall(f, branches[0], f->at, f->path);
+        }
+        if (ret > f->st)
+            f->st = ret;
+        if (f->st >= COND_MAYBE_POS_VALID)
+            f->iok = branches[f->ci];
+        if (f->st != COND_OK && ++f->ci < op.brcnt)
+            return evalCall(f, branches[f->ci], f->at, f->path);
+        if (f->path && f->st >= COND_MAYBE_POS_VALID)
+        {
+            f->path[c.save] = f->at;
+            for (int j = 0; j < op.brcnt; j++)
+            {   // invalidate the other branches
+                int b = branches[j];
+                if (b == f->iok)
+                    continue;
+                Pos *p = f->path + tree->condvec[b].save;
+                p->x = p->z = -1;
+            }
+        }
+        return f->st;
+
+    case CondOp::OP_NOT:
+        if (entry)
+        {
+            if (op.brcnt == 0)
+                return COND_FAILED;
+            f->st = COND_OK;
+            f->ci = 0;
+            return evalCall(f, branches[0], f->at, f->path);
+        }
+        if      (ret == COND_OK) return COND_FAILED;
+        else if (ret == COND_FAILED) return COND_OK;
+        else if (ret > f->st) f->st = ret;
+        if (++f->ci < op.brcnt)
+            return evalCall(f, branches[f->ci], f->at, f->path);
+        return f->st;
+
+    case CondOp::OP_LUA:
+        {
+            lua_State *L = env->l_nodes[f->node];
+            if (entry)
             {
-                st = testCondAt(at, env, &inst[0], NULL, &c);
-                if (st == COND_FAILED || st == COND_MAYBE_POS_INVAL)
-                    return st;
-                pos = inst[0]; // center point of instances
+                f->st = COND_OK;
+                if (!L)
+                    return COND_OK;
+                f->buf = f->path ? f->path : &inst[0];
+                f->ci = 0;
             }
-            for (char b : branches)
+            else
             {
-                if (st == COND_FAILED)
-                    break;
-                int sta = _testTreeAt(pos, env, path, b);
-                if (*env->stop)
-                    return COND_FAILED;
-                if (sta < st)
-                    st = sta;
+                if (ret < f->st) {
+                    f->st = ret;
+                    if (f->st == COND_FAILED)
+                        return f->st;
+                }
+                f->ci++;
             }
-            if (path && st >= COND_MAYBE_POS_VALID)
-                path[c.save] = pos;
-            return st;
+            if (f->ci < op.andcnt)
+                return evalCall(f, order[f->ci], f->at, f->buf);
+            if (f->st <= COND_MAYBE_POS_INVAL)
+                return f->st;
+            int sta = runCheckScript(L, f->at, env, env->searchpass, f->buf, &c);
+            if (*env->stop)
+                return COND_FAILED;
+            if (sta < f->st)
+                f->st = sta;
+            return f->st;
         }
-        else
-        {   // check each instance individually, splitting the instances into
-            // independent subbranches that are combined via OR
-            int icnt = MAX_INSTANCES;
-            st = testCondAt(at, env, &inst[0], &icnt, &c);
-            if (st == COND_FAILED || st == COND_MAYBE_POS_INVAL)
-                return st;
-            int sta = COND_FAILED;
-            int iok = 0;
-            for (int i = 0; i < icnt; i++) // OR instance subbranches
+
+    default:
+        break;
+    }
+    return COND_FAILED;
+}
+
+static int evalTree(Pos at, SearchThreadEnv *env, Pos *path)
+{
+    EvalFrame *stack = env->evalstack.data();
+    CondStats *stats = env->stats[env->searchpass].data();
+    EvalFrame *f = stack;
+    f->node = 0;
+    f->at = at;
+    f->path = path;
+    bool entry = true;
+    int ret = COND_OK;
+    while (true)
+    {
+        if (entry)
+        {   // time only a sample of the evaluations to keep the overhead low,
+            // but all branches of a timed evaluation to get its own time
+            f->timed = (stats[f->node].evals++ & 63) == 0 || (f != stack && f[-1].timed);
+            if (f->timed)
             {
-                int stb = COND_OK;
-                pos = inst[i];
-                for (int b : branches) // AND dependent conditions
-                {
-                    int stc = _testTreeAt(pos, env, path, b);
-                    if (*env->stop)
-                        return COND_FAILED;
-                    // worst branch dictates status for instance
-                    if (stc < stb)
-                        stb = stc;
-                    if (stb == COND_FAILED)
-                        break;
-                }
-                // best instance dictates status
-                if (stb > sta) {
-                    sta = stb;
-                    if (sta >= COND_MAYBE_POS_VALID)
-                        iok = i; // save position with ok path
-                }
-                if (sta >= st)
-                    break; // status is as good as we need
+                f->tchild = 0;
+                f->t0 = evalClock();
             }
-            // status cannot be better than it was for this condition
-            if (sta < st)
-                st = sta;
-            if (path && st >= COND_MAYBE_POS_VALID)
-                path[c.save] = inst[iok];
-            return st;
         }
+        ret = evalStep(env, f, entry, ret);
+        if (ret == EVAL_CALL)
+        {
+            f++;
+            entry = true;
+            continue;
+        }
+        CondStats& cs = stats[f->node];
+        if (f->timed)
+        {
+            int64_t dt = evalClock() - f->t0;
+            cs.ns += dt;
+            cs.selfns += dt - f->tchild;
+            cs.timed++;
+            if (f != stack)
+                f[-1].tchild += dt;
+        }
+        if (ret == COND_FAILED)
+            cs.fails++;
+        else if (ret == COND_OK)
+            cs.passes++;
+        else
+            cs.maybes++;
+        if (f == stack)
+            return ret;
+        f--;
+        entry = false;
     }
 }
 
@@ -682,103 +1320,181 @@ int testTreeAt(
     if (pass != PASS_FAST_48)
     {   // do a fast check before continuing with slower checks
         env->searchpass = PASS_FAST_48;
-        int st = _testTreeAt(at, env, NULL, 0);
+        int st = evalTree(at, env, NULL);
         if (st == COND_FAILED)
             return st;
     }
     env->searchpass = pass;
-    return _testTreeAt(at, env, path, 0);
+    return evalTree(at, env, path);
 }
 
 
-static const QuadInfo *getQHInfo(uint64_t cst)
+// The quad-structure properties are kept in tables with a perfect hash over
+// their constellations, which are set up once on first use (by a thread-safe
+// static initializer) and are read without locking afterwards. A key selects
+// a bucket, and the displacement of the bucket moves its keys to slots that
+// no other key uses, so that a lookup probes exactly one slot.
+struct QuadTable
 {
-    static std::map<uint64_t, QuadInfo> qh_info;
-    static QMutex mutex;
+    std::vector<QuadInfo> info;
+    std::vector<uint32_t> disp;     // displacement of each bucket
+    std::vector<int> slot;          // index into 'info', or -1
 
-    mutex.lock();
-    if (qh_info.size() == 0)
+    explicit QuadTable(std::vector<QuadInfo>&& v)
+        : info(std::move(v))
     {
-        StructureConfig sc;
-        getStructureConfig(Swamp_Hut, MC_NEWEST, &sc);
-        sc.salt = 0; // ignore version dependent salt offsets
+        size_t m = 2;
+        while (m < 2 * info.size())
+            m *= 2;
+        while (!place(m))
+            m *= 2;
+    }
 
-        for (const uint64_t *cst = low20QuadHutBarely; *cst; cst++)
+    static uint64_t hash(uint64_t c)
+    {
+        c ^= c >> 31;
+        c *= 0x9e3779b97f4a7c15ULL;
+        c ^= c >> 29;
+        return c;
+    }
+
+    size_t index(uint64_t h) const
+    {   // (the displacement reseeds the slots of the keys in the bucket)
+        uint64_t x = h + disp[(h >> 32) & (disp.size() - 1)] * 0x9e3779b97f4a7c15ULL;
+        x ^= x >> 32;
+        x *= 0xd6e8feb86659fd93ULL;
+        x ^= x >> 32;
+        return x & (slot.size() - 1);
+    }
+
+    const QuadInfo *find(uint64_t c) const
+    {
+        int i = slot[index(hash(c))];
+        if (i < 0 || info[i].c != c)
+            return nullptr;
+        return &info[i];
+    }
+
+    bool place(size_t m)
+    {
+        // about four keys per bucket, placing the largest buckets first
+        size_t nb = 1;
+        while (nb * 4 < info.size())
+            nb *= 2;
+        std::vector<std::vector<int>> buckets(nb);
+        for (size_t i = 0; i < info.size(); i++)
+            buckets[(hash(info[i].c) >> 32) & (nb - 1)].push_back(i);
+        std::stable_sort(buckets.begin(), buckets.end(),
+            [](const std::vector<int>& a, const std::vector<int>& b) { return a.size() > b.size(); });
+
+        disp.assign(nb, 0);
+        slot.assign(m, -1);
+        for (const std::vector<int>& b : buckets)
         {
-            for (uint64_t s = *cst;; s += 0x100000)
+            if (b.empty())
+                break;
+            uint64_t h0 = hash(info[b[0]].c);
+            uint32_t *d = &disp[(h0 >> 32) & (nb - 1)];
+            for (*d = 0; *d < m; ++*d)
             {
-                // find a quad-hut for this constellation
-                Pos pc;
-                if (scanForQuads(sc, 128, s, low20QuadHutBarely, 20, 0, 0, 0, 1, 1, &pc, 1) < 1)
-                    continue;
-                qreal rad = isQuadBase(sc, s, 160);
-                if (rad == 0)
-                    continue;
-
-                QuadInfo *qi = &qh_info[*cst];
-                qi->rad = rad;
-                qi->c = *cst;
-                qi->p[0] = getFeaturePos(sc, s, 0, 0);
-                qi->p[1] = getFeaturePos(sc, s, 0, 1);
-                qi->p[2] = getFeaturePos(sc, s, 1, 0);
-                qi->p[3] = getFeaturePos(sc, s, 1, 1);
-                qi->afk = getOptimalAfk(qi->p, 7,7,9, &qi->spcnt);
-                qi->typ = Swamp_Hut;
-
-                switch (getQuadHutCst(*cst))
+                size_t k = 0;
+                for (; k < b.size(); k++)
                 {
-                case CST_IDEAL:   qi->flt = F_QH_IDEAL;   break;
-                case CST_CLASSIC: qi->flt = F_QH_CLASSIC; break;
-                case CST_NORMAL:  qi->flt = F_QH_NORMAL;  break;
-                default:          qi->flt = F_QH_BARELY;
+                    int& s = slot[index(hash(info[b[k]].c))];
+                    if (s >= 0)
+                        break;
+                    s = b[k];
                 }
-                break;
+                if (k == b.size())
+                    break;
+                while (k-- > 0)
+                    slot[index(hash(info[b[k]].c))] = -1;
             }
+            if (*d == m)
+                return false;
         }
+        return true;
     }
-    mutex.unlock();
-
-    auto it = qh_info.find(cst);
-    if (it == qh_info.end())
-        return nullptr;
-    else
-        return &it->second;
-}
+};
 
-static const QuadInfo *getQMInfo(uint64_t s48)
+static std::vector<QuadInfo> initQHInfo()
 {
-    static std::map<uint64_t, QuadInfo> qm_info;
-    static QMutex mutex;
+    std::vector<QuadInfo> qh_info;
+    StructureConfig sc;
+    getStructureConfig(Swamp_Hut, MC_NEWEST, &sc);
+    sc.salt = 0; // ignore version dependent salt offsets
 
-    mutex.lock();
-    if (qm_info.size() == 0)
+    for (const uint64_t *cst = low20QuadHutBarely; *cst; cst++)
     {
-        StructureConfig sc;
-        getStructureConfig(Monument, MC_NEWEST, &sc);
-        sc.salt = 0;
-
-        for (const uint64_t *s = g_qm_90; *s; s++)
+        for (uint64_t s = *cst;; s += 0x100000)
         {
-            QuadInfo *qi = &qm_info[*s];
-            qi->rad = isQuadBase(sc, *s, 160);
-            qi->c = *s;
-            qi->p[0] = getLargeStructurePos(sc, *s, 0, 0);
-            qi->p[1] = getLargeStructurePos(sc, *s, 0, 1);
-            qi->p[2] = getLargeStructurePos(sc, *s, 1, 0);
-            qi->p[3] = getLargeStructurePos(sc, *s, 1, 1);
-            qi->afk = getOptimalAfk(qi->p, 58,0/*23*/,58, &qi->spcnt);
-            qi->afk.x -= 29;
-            qi->afk.z -= 29;
-            qi->typ = Monument;
+            // find a quad-hut for this constellation
+            Pos pc;
+            if (scanForQuads(sc, 128, s, low20QuadHutBarely, 20, 0, 0, 0, 1, 1, &pc, 1) < 1)
+                continue;
+            qreal rad = isQuadBase(sc, s, 160);
+            if (rad == 0)
+                continue;
+
+            QuadInfo qi = QuadInfo();
+            qi.rad = rad;
+            qi.c = *cst;
+            qi.p[0] = getFeaturePos(sc, s, 0, 0);
+            qi.p[1] = getFeaturePos(sc, s, 0, 1);
+            qi.p[2] = getFeaturePos(sc, s, 1, 0);
+            qi.p[3] = getFeaturePos(sc, s, 1, 1);
+            qi.afk = getOptimalAfk(qi.p, 7,7,9, &qi.spcnt);
+            qi.typ = Swamp_Hut;
+
+            switch (getQuadHutCst(*cst))
+            {
+            case CST_IDEAL:   qi.flt = F_QH_IDEAL;   break;
+            case CST_CLASSIC: qi.flt = F_QH_CLASSIC; break;
+            case CST_NORMAL:  qi.flt = F_QH_NORMAL;  break;
+            default:          qi.flt = F_QH_BARELY;
+            }
+            qh_info.push_back(qi);
+            break;
         }
     }
-    mutex.unlock();
+    return qh_info;
+}
 
-    auto it = qm_info.find(s48);
-    if (it == qm_info.end())
-        return nullptr;
-    else
-        return &it->second;
+static std::vector<QuadInfo> initQMInfo()
+{
+    std::vector<QuadInfo> qm_info;
+    StructureConfig sc;
+    getStructureConfig(Monument, MC_NEWEST, &sc);
+    sc.salt = 0;
+
+    for (const uint64_t *s = g_qm_90; *s; s++)
+    {
+        QuadInfo qi = QuadInfo();
+        qi.rad = isQuadBase(sc, *s, 160);
+        qi.c = *s;
+        qi.p[0] = getLargeStructurePos(sc, *s, 0, 0);
+        qi.p[1] = getLargeStructurePos(sc, *s, 0, 1);
+        qi.p[2] = getLargeStructurePos(sc, *s, 1, 0);
+        qi.p[3] = getLargeStructurePos(sc, *s, 1, 1);
+        qi.afk = getOptimalAfk(qi.p, 58,0/*23*/,58, &qi.spcnt);
+        qi.afk.x -= 29;
+        qi.afk.z -= 29;
+        qi.typ = Monument;
+        qm_info.push_back(qi);
+    }
+    return qm_info;
+}
+
+static const QuadInfo *getQHInfo(uint64_t cst)
+{
+    static const QuadTable qh_info(initQHInfo());
+    return qh_info.find(cst);
+}
+
+static const QuadInfo *getQMInfo(uint64_t s48)
+{
+    static const QuadTable qm_info(initQMInfo());
+    return qm_info.find(s48);
 }
 
 
@@ -809,7 +1525,7 @@ static bool isVariantOk(const Condition *c, SearchThreadEnv *e, int stype, int v
     {
         if (e->mc <= MC_1_15) return true;
         e->init4Dim(stype == Ruined_Portal ? DIM_OVERWORLD : DIM_NETHER);
-        varbiome = getBiomeAt(&e->g, 4, (pos->x >> 2) + 2, 0, (pos->z >> 2) + 2);
+        varbiome = getBiomeAt(e->g, 4, (pos->x >> 2) + 2, 0, (pos->z >> 2) + 2);
         getVariant(&sv, stype, e->mc, e->seed, pos->x, pos->z, varbiome);
         if (!(c->varflags & Condition::VAR_WITH_START)) return true;
     }
@@ -982,6 +1698,7 @@ struct sample_boime_t
     Pos *cent;
     int *imax;
     std::atomic_bool *stop;
+    DoublePerlinNoise *dpn;
 };
 
 static int f_biome_sampler(Generator *g, int scale, int x, int y, int z, void *data)
@@ -1027,6 +1744,7 @@ static int f_biome_sampler(Generator *g, int scale, int x, int y, int z, void *d
 
 static int f_noise_sampler(Generator *g, int scale, int x, int y, int z, void *data)
 {
+    (void) g;
     (void) y;
     sample_boime_t *info = (sample_boime_t*) data;
     if (info->stop && *info->stop)
@@ -1041,7 +1759,7 @@ static int f_noise_sampler(Generator *g, int scale, int x, int y, int z, void *d
     }
 
     const Condition *cond = info->cond;
-    double v = sampleDoublePerlin(&g->bn.climate[cond->para], x, 0, z);
+    double v = sampleDoublePerlin(info->dpn, x, 0, z);
     double vmin = cond->minmax & Condition::E_TEST_LOWER ? cond->vmin : -INFINITY;
     double vmax = cond->minmax & Condition::E_TEST_UPPER ? cond->vmax : +INFINITY;
 
@@ -1082,6 +1800,21 @@ testCondAt(
     int                       * imax,           // max instances (NULL for avg)
     const Condition           * cond            // condition to check
     )
+{
+    CondOp op;
+    op.set(*cond, env->mc);
+    return _testCondAt(at, env, cent, imax, cond, op);
+}
+
+static int
+_testCondAt(
+    Pos                         at,             // relative origin
+    SearchThreadEnv           * env,            // thread-local environment
+    Pos                       * cent,           // output center position(s)
+    int                       * imax,           // max instances (NULL for avg)
+    const Condition           * cond,           // condition to check
+    const CondOp              & op              // compiled condition
+    )
 {
     int x1, x2, z1, z2;
     int rx1, rx2, rz1, rz2, rx, rz;
@@ -1093,25 +1826,26 @@ testCondAt(
     int i, n, icnt;
     int64_t s, r, rmin, rmax;
     const uint64_t *seeds;
-    Pos *p = getPosBuf(0);
+    // scratch buffer behind the instance buffers of the conditions
+    Pos *p = &env->posbuf[env->posbuf.size() - MAX_INSTANCES];
 
-    const FilterInfo& finfo = g_filterinfo.list[cond->type];
+    const FilterInfo& finfo = *op.finfo;
 
     if ((st = finfo.stype) > 0)
     {
-        if (!getStructureConfig_override(finfo.stype, env->mc, &sconf))
+        if (!op.sconfok)
             return COND_FAILED;
+        sconf = op.sconf;
     }
     else memset(&sconf, 0, sizeof(sconf)); // never relevant, but clang-analyzer complains
 
-    if (cond->rmax > 0)
+    if (op.rad >= 0)
     {
-        rmax = cond->rmax - 1;
-        x1 = at.x - rmax;
-        z1 = at.z - rmax;
-        x2 = at.x + rmax;
-        z2 = at.z + rmax;
-        rmax = rmax * rmax + 1;
+        x1 = at.x - op.rad;
+        z1 = at.z - op.rad;
+        x2 = at.x + op.rad;
+        z2 = at.z + op.rad;
+        rmax = op.rmaxsq;
     }
     else
     {
@@ -1314,8 +2048,10 @@ L_qm_any:
         {
             for (rx = rx1; rx <= rx2; rx++)
             {
-                if (!getStructurePos(st, env->mc, env->seed, rx+0, rz+0, &pc))
+                SearchThreadEnv::StructEntry *se = env->getStructEntry(st, rx, rz);
+                if (!se->ok)
                     continue;
+                pc = se->pos;
                 if (cond->skipref && pc.x == at.x && pc.z == at.z)
                     continue;
                 if (rmax)
@@ -1351,28 +2087,33 @@ L_qm_any:
                             continue;
                     }
 
-                    env->init4Dim(finfo.dim);
-                    int id = isViableStructurePos(st, &env->g, pc.x, pc.z, 0);
-                    if (!id)
-                        continue;
-                    if (st == End_City)
-                    {
-                        env->prepareSurfaceNoise(DIM_END);
-                        if (!isViableEndCityTerrain(&env->g, &env->sn, pc.x, pc.z))
-                            continue;
+                    if (se->vgen != env->vgen)
+                    {   // biome and terrain viability, shared by all conditions
+                        env->init4Dim(finfo.dim);
+                        int id = isViableStructurePos(st, env->g, pc.x, pc.z, 0);
+                        if (id && st == End_City)
+                        {
+                            env->prepareSurfaceNoise(DIM_END);
+                            if (!isViableEndCityTerrain(env->g, &env->sn, pc.x, pc.z))
+                                id = 0;
+                        }
+                        if (id && env->mc >= MC_1_18)
+                        {
+                            if (g_extgen.estimateTerrain &&
+                                !isViableStructureTerrain(st, env->g, pc.x, pc.z))
+                            {
+                                id = 0;
+                            }
+                        }
+                        se->id = id;
+                        se->vgen = env->vgen;
                     }
+                    if (!se->id)
+                        continue;
                     if (cond->varflags)
                     {
-                        if (!isVariantOk(cond, env, st, id, &pc))
-                            continue;
-                    }
-                    if (env->mc >= MC_1_18)
-                    {
-                        if (g_extgen.estimateTerrain &&
-                            !isViableStructureTerrain(st, &env->g, pc.x, pc.z))
-                        {
+                        if (!isVariantOk(cond, env, st, se->id, &pc))
                             continue;
-                        }
                     }
                 }
 
@@ -1524,8 +2265,7 @@ L_qm_any:
             return COND_MAYBE_POS_INVAL;
 
         if (*env->stop) return COND_FAILED;
-        env->init4Dim(DIM_OVERWORLD);
-        pc = getSpawn(&env->g);
+        pc = env->getSpawnPos();
         if (rmax)
         {
             int dx = pc.x - at.x;
@@ -1547,11 +2287,8 @@ L_qm_any:
 
 
     case F_FIRST_STRONGHOLD:
-        {
-            StrongholdIter sh;
-            *cent = pc = initFirstStronghold(&sh, env->mc, env->seed);
-            if (imax) *imax = 1;
-        }
+        *cent = pc = env->getFirstStronghold();
+        if (imax) *imax = 1;
         if (cond->rmax > 0)
         {
             int dx = pc.x - at.x;
@@ -1655,29 +2392,27 @@ L_qm_any:
             else
                 rmax = 0;
 
-            StrongholdIter sh;
-            initFirstStronghold(&sh, env->mc, env->seed);
+            const SearchThreadEnv::StrongholdEntry *sh;
             icnt = 0;
             xt = zt = 0;
-            env->init4Dim(DIM_OVERWORLD);
-            while (nextStronghold(&sh, &env->g) > 0)
+            for (int i = 0; (sh = env->getStronghold(i)) && sh->rem > 0; i++)
             {
                 if (*env->stop)
                     break;
                 bool inside;
                 if (rmax)
                 {
-                    int dx = sh.pos.x - at.x;
-                    int dz = sh.pos.z - at.z;
+                    int dx = sh->pos.x - at.x;
+                    int dz = sh->pos.z - at.z;
                     int64_t rsq = dx*(int64_t)dx + dz*(int64_t)dz;
                     inside = (rsq < rmax);
                 }
                 else
                 {
-                    inside = (sh.pos.x >= x1 && sh.pos.x <= x2 &&
-                              sh.pos.z >= z1 && sh.pos.z <= z2);
+                    inside = (sh->pos.x >= x1 && sh->pos.x <= x2 &&
+                              sh->pos.z >= z1 && sh->pos.z <= z2);
                 }
-                if (cond->skipref && sh.pos.x == at.x && sh.pos.z == at.z)
+                if (cond->skipref && sh->pos.x == at.x && sh->pos.z == at.z)
                     inside = false;
                 if (inside)
                 {
@@ -1687,19 +2422,19 @@ L_qm_any:
                     }
                     else if (imax)
                     {
-                        cent[icnt] = sh.pos;
+                        cent[icnt] = sh->pos;
                         icnt++;
                         if (icnt >= *imax)
                             return COND_OK;
                     }
                     else
                     {
-                        xt += sh.pos.x;
-                        zt += sh.pos.z;
+                        xt += sh->pos.x;
+                        zt += sh->pos.z;
                         icnt++;
                     }
                 }
-                if (sh.ringnum > r)
+                if (sh->ringnum > r)
                     break;
             }
             if (cond->count == 0)
@@ -1812,6 +2547,7 @@ L_qm_any:
             sample.imax = imax;
             sample.cent = cent;
             sample.stop = env->stop;
+            sample.dpn = NULL;
 
             uint64_t rng;
             setSeed(&rng, env->seed);
@@ -1820,7 +2556,7 @@ L_qm_any:
 
             if (cond->type == F_NOISE_SAMPLE)
             {
-                env->init4Noise(cond->para, cond->octave);
+                sample.dpn = env->init4Noise(cond->para, cond->octave);
                 f = f_noise_sampler;
             }
             else
@@ -1828,7 +2564,7 @@ L_qm_any:
                 env->init4Dim(DIM_OVERWORLD);
                 f = f_biome_sampler;
             }
-            int ok = monteCarloBiomes(&env->g, r, &rng, cond->converage, cond->confidence, f, &sample);
+            int ok = monteCarloBiomes(env->g, r, &rng, cond->converage, cond->confidence, f, &sample);
             if (imax && cond->count == 1)
             {
                 *imax = sample.n;
@@ -1876,12 +2612,13 @@ L_qm_any:
             int w = rx2-rx1+1;
             int h = rz2-rz1+1;
             //env->init4Dim(0); // seed gets applied by checkForBiomesAtLayer
+            LayerStack *ls = &env->getGen(DIM_OVERWORLD)->ls;
             Layer *entry;
             if (cond->type == F_BIOME_4_RIVER)
-                entry = &env->g.ls.layers[L_RIVER_4];
+                entry = &ls->layers[L_RIVER_4];
             else
-                entry = &env->g.ls.layers[L_OCEAN_TEMP_256];
-            if (checkForBiomesAtLayer(&env->g.ls, entry,
+                entry = &ls->layers[L_OCEAN_TEMP_256];
+            if (checkForBiomesAtLayer(ls, entry,
                 NULL, env->seed, rx1, rz1, w, h, &cond->bf) > 0)
             {
                 valid = COND_OK;
@@ -1903,7 +2640,7 @@ L_qm_any:
         if (env->searchpass != PASS_FULL_64)
             return COND_MAYBE_POS_VALID;
         env->init4Dim(DIM_OVERWORLD);
-        if (checkForTemps(&env->g.ls, env->seed, rx1, rz1, rx2-rx1+1, rz2-rz1+1, cond->temps))
+        if (checkForTemps(&env->g->ls, env->seed, rx1, rz1, rx2-rx1+1, rz2-rz1+1, cond->temps))
             return COND_OK;
         return COND_FAILED;
 
@@ -1941,7 +2678,7 @@ L_qm_any:
             int h = rz2 - rz1 + 1;
             int y = (s == 0 ? cond->y : cond->y >> 2);
             Range r = {1<<s, rx1, rz1, w, h, y, 1};
-            valid = checkForBiomes(&env->g, NULL, r, finfo.dim, env->seed,
+            valid = checkForBiomes(env->getGen(finfo.dim), NULL, r, finfo.dim, env->seed,
                 &cond->bf, (volatile char*)env->stop) > 0;
         }
         return valid ? COND_OK : COND_FAILED;
@@ -1964,7 +2701,7 @@ L_qm_any:
             if (cond->count <= 0)
             {   // exclusion
                 icnt = getBiomeCenters(
-                    cent, NULL, 1, &env->g, r, cond->biomeId, cond->biomeSize, cond->tol,
+                    cent, NULL, 1, env->g, r, cond->biomeId, cond->biomeSize, cond->tol,
                     (volatile char*)env->stop
                 );
                 if (icnt == 0)
@@ -1978,7 +2715,7 @@ L_qm_any:
             else if (imax)
             {   // just check there are at least *inst (== cond->count) instances
                 *imax = icnt = getBiomeCenters(
-                    cent, NULL, cond->count, &env->g, r, cond->biomeId, cond->biomeSize, cond->tol,
+                    cent, NULL, cond->count, env->g, r, cond->biomeId, cond->biomeSize, cond->tol,
                     (volatile char*)env->stop
                 );
                 if (cond->skipref && icnt > 0)
@@ -1999,7 +2736,7 @@ L_qm_any:
             else
             {   // we need the average position of all instances
                 icnt = getBiomeCenters(
-                    &p[0], NULL, MAX_INSTANCES, &env->g, r, cond->biomeId, cond->biomeSize, cond->tol,
+                    &p[0], NULL, MAX_INSTANCES, env->g, r, cond->biomeId, cond->biomeSize, cond->tol,
                     (volatile char*)env->stop
                 );
                 xt = zt = 0;
@@ -2036,11 +2773,11 @@ L_qm_any:
             track_minmax_t info = {at, at, +INFINITY, -INFINITY};
             int w = rx2 - rx1 + 1;
             int h = rz2 - rz1 + 1;
-            env->init4Noise(cond->para, cond->octave);
+            DoublePerlinNoise *dpn = env->init4Noise(cond->para, cond->octave);
             double para[2] = {+INFINITY, -INFINITY};
             double *p_min = (cond->minmax & Condition::E_LOCATE_MIN) ? para+0 : nullptr;
             double *p_max = (cond->minmax & Condition::E_LOCATE_MAX) ? para+1 : nullptr;
-            getParaRange(&env->g.bn.climate[cond->para], p_min, p_max,
+            getParaRange(dpn, p_min, p_max,
                     rx1, rz1, w, h, &info, f_track_minmax);
             double vmin = cond->minmax & Condition::E_TEST_LOWER ? cond->vmin : -INFINITY;
             double vmax = cond->minmax & Condition::E_TEST_UPPER ? cond->vmax : +INFINITY;
@@ -2110,7 +2847,7 @@ L_qm_any:
                     (double)cond->limex[i][0],
                     (double)cond->limex[i][1],
                 };
-                int err = getParaRange(&env->g.bn.climate[i], &pmin, &pmax, rx1, rz1, w, h, (void*)bounds, f_confine);
+                int err = getParaRange(&env->g->bn.climate[i], &pmin, &pmax, rx1, rz1, w, h, (void*)bounds, f_confine);
                 if (err)
                 {
                     valid = 0;
@@ -2150,7 +2887,7 @@ L_qm_any:
             int ymin = cond->limok[NP_DEPTH][0];
             int ymax = cond->limok[NP_DEPTH][1];
             float y;
-            mapApproxHeight(&y, nullptr, &env->g, &env->sn, rx1, rz1, 1, 1);
+            mapApproxHeight(&y, nullptr, env->g, &env->sn, rx1, rz1, 1, 1);
             if (cond->flags & Condition::FLG_IN_RANGE)
                 valid = y >= ymin && y <= ymax;
             else
@@ -672,31 +672,171 @@ enum
     PASS_FULL_64,       // run full test on a 64-bit seed
 };
 
+// runtime counters of a condition in the tree for one search pass
+struct CondStats
+{
+    uint64_t evals; // number of evaluations
+    uint64_t passes; // number of evaluations that passed (COND_OK)
+    uint64_t maybes; // number of evaluations that were undecided in the pass
+    uint64_t fails; // number of evaluations that failed
+    uint64_t timed; // number of timed (sampled) evaluations
+    uint64_t ns;    // time of the timed evaluations, including the branches
+    uint64_t selfns; // time of the timed evaluations, without the branches
+};
+
+// A condition of the tree compiled for evaluation, with the filter info,
+// structure config and area resolved ahead of time.
+struct CondOp
+{
+    enum {
+        OP_LEAF,    // condition without branches
+        OP_CENTER,  // branches at the center of the instances (or the root)
+        OP_SPLIT,   // branches at each instance, combined via OR
+        OP_SPIRAL,  // spiral iterator
+        OP_SCALE,   // scale to another dimension
+        OP_OR,
+        OP_NOT,
+        OP_LUA,
+    };
+    int kind;
+    const FilterInfo *finfo;
+    int sconfok;    // structure config is valid (only for structures)
+    StructureConfig sconf;
+    int rad;        // radius - 1 for circular areas, otherwise -1
+    int64_t rmaxsq; // squared radius for circular areas
+    // branches combined via AND in the planned order, per pass
+    int andoff[PASS_FULL_64+1];
+    int andcnt;
+    // branches in the user order, for OR and NOT gates
+    int broff;
+    int brcnt;
+
+    void set(const Condition& c, int mc);
+};
+
 struct ConditionTree
 {
     std::vector<Condition> condvec;
     std::vector<std::vector<char>> references;
+    // execution plan: evaluation order of the references for each search
+    // pass, where branches that are combined via AND are sorted by their
+    // estimated cost per rejection (OR and NOT gates keep the user order)
+    std::vector<std::vector<char>> plan[PASS_FULL_64+1];
+    // compiled program with one operation per condition, where the
+    // branches of the operations are listed in progrefs
+    std::vector<CondOp> prog;
+    std::vector<int> progrefs;
+
+    // timed samples that are needed before a measurement is used
+    enum { STATS_MIN_TIMED = 8 };
 
     ~ConditionTree();
     QString set(const std::vector<Condition>& cv, int mc);
+
+    // Rebuild the execution plan. Measured runtime counters (per pass) take
+    // precedence over the static estimates, where enough were sampled.
+    void optimize(int mc, const std::vector<CondStats> *stats);
+
+    // Compact text form of the plan, which has a fixed length for the tree.
+    QString planString() const;
+    bool readPlan(const QString& s);
+
+    // Compile the conditions into the program, and (re-)link the branches
+    // of the program with the current plan.
+    void compile(int mc);
+    void link();
+
+private:
+    void estimate(int node, int mc, int pass, const CondStats *stats, double unit,
+                  std::vector<double>& ecost, double *cost, double *prob);
+};
+
+// Evaluation state of a condition in the (iterative) program evaluation.
+struct EvalFrame
+{
+    int node;
+    Pos at;
+    Pos *path;
+    int st, sta, stb; // accumulated statuses
+    int ci;         // index of the current branch
+    int i, n, iok;  // instance index, count and ok instance
+    Pos pos;        // position for the branches
+    Pos *buf;       // path buffer for scripts
+    // spiral iterator
+    int step, rmax, x1, z1, x2, z2, rx1, rz1, rx2, rz2, rx, rz, dl, dx, dz;
+    bool timed;
+    int64_t t0;
+    int64_t tchild; // time of the branches of a timed evaluation
 };
 
 struct SearchThreadEnv
 {
     ConditionTree condtree;
 
-    Generator g;
+    // separate generators per dimension, which are seeded lazily, so that
+    // conditions in different dimensions do not re-seed a shared state
+    Generator gen[3];   // Nether, Overworld, End
+    Generator *g;       // generator of the most recently initialized dimension
     SurfaceNoise sn;
 
     int mc, large;
     uint64_t seed;
     int surfdim;
-    int octaves;
 
     int searchpass;
     std::atomic_bool *stop;
 
+    // evaluation counters per condition and pass
+    std::vector<CondStats> stats[PASS_FULL_64+1];
+
+    // per-seed memo of structure positions and their viability, where the
+    // positions are kept while only the upper 16 bits of the seed change
+    struct StructEntry
+    {
+        int stype, rx, rz;
+        uint32_t pgen;  // generation of the position
+        uint32_t vgen;  // generation of the viability (0 = unknown)
+        int ok;         // structure generation attempt in region
+        int id;         // viability (biome id or 0 if not viable)
+        Pos pos;
+    };
+    enum { STRUCT_CACHE_SIZE = 4096 };
+    std::vector<StructEntry> scache;
+    uint32_t pgen, vgen;
+
+    // per-seed memo of the strongholds, which are generated lazily, and
+    // of the world spawn (valid while the generation matches vgen)
+    struct StrongholdEntry
+    {
+        Pos pos;
+        int ringnum;    // ring number of the iterator after this stronghold
+        int rem;        // strongholds that remain after this one
+    };
+    StrongholdIter shiter;
+    std::vector<StrongholdEntry> shlist;
+    Pos shfirst;        // approximate position of the first stronghold
+    bool shdone;        // all strongholds have been generated
+    uint32_t shgen;
+    Pos spawn;
+    uint32_t spawngen;
+
+    // per-seed cache of climate parameter noise, with one entry for each
+    // parameter and octave count sampled by the conditions, plus a spare
+    struct NoiseEntry
+    {
+        int nptype, octaves;
+        uint32_t gen;   // seed generation of the noise (0 = unseeded)
+        BiomeNoise bn;
+    };
+    std::vector<NoiseEntry> ncache;
+
     std::map<uint64_t, lua_State*> l_states;
+    std::vector<lua_State*> l_nodes; // script state per condition
+
+    // instance buffers per condition (and a scratch buffer), and the stack
+    // for the program evaluation
+    std::vector<Pos> posbuf;
+    std::vector<EvalFrame> evalstack;
 
     SearchThreadEnv();
     ~SearchThreadEnv();
@@ -704,8 +844,14 @@ struct SearchThreadEnv
     QString init(int mc, bool large, const ConditionTree& condtree);
 
     void setSeed(uint64_t seed);
+    StructEntry *getStructEntry(int stype, int rx, int rz);
+    Pos getFirstStronghold();
+    // Get the i-th stronghold, or NULL after the last one.
+    const StrongholdEntry *getStronghold(int i);
+    Pos getSpawnPos();
+    Generator *getGen(int dim) { return &gen[dim - DIM_NETHER]; }
     void init4Dim(int dim);
-    void init4Noise(int nptype, int octaves);
+    DoublePerlinNoise *init4Noise(int nptype, int octaves);
     void prepareSurfaceNoise(int dim);
 };
 
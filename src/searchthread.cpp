@@ -1,7 +1,7 @@
 #include "searchthread.h"
 
 #include "aboutdialog.h"
-#include "formsearchcontrol.h"
+#include "cpudispatch.h"
 #include "message.h"
 #include "seedtables.h"
 
@@ -16,6 +16,10 @@
 #include <QDirIterator>
 #include <QVector>
 
+#include <algorithm>
+#include <set>
+
+#include <inttypes.h>
 
 void Session::writeHeader(QTextStream& stream)
 {
@@ -83,6 +87,12 @@ bool Session::load(QWidget *widget, QTextStream& stream, bool quiet)
         if (gen48.read(line)) continue;
         if (wi.read(line)) continue;
 
+        if (line.startsWith("#Plan:"))
+        {
+            plan = line.mid(6).trimmed();
+            continue;
+        }
+
         if (line.startsWith("#Cond:"))
         {   // Conditions
             Condition c;
@@ -130,10 +140,9 @@ SearchMaster::SearchMaster(QWidget *parent)
     : QObject(parent)
     , mutex()
     , stop()
+    , drain()
     , proghist()
     , progtimer()
-    , itemtimer()
-    , count()
     , env()
     , searchtype()
     , mc()
@@ -143,20 +152,108 @@ SearchMaster::SearchMaster(QWidget *parent)
     , threadcnt()
     , gen48()
     , slist()
+    , sortmem((uint64_t)1 << 30)
     , idx()
     , scnt()
     , prog()
     , seed()
     , smin()
     , smax()
+    , shard()
+    , shards()
+    , leased()
+    , lfirst()
+    , llast()
+    , prepared()
     , isdone()
+    , sbegin()
+    , send()
+    , sfull()
+    , lowmin()
+    , cursor()
+    , version()
+    , transfers()
+    , frozen()
+    , completed()
+    , qmutex()
+    , bases()
+    , queuemin(~(uint64_t)0)
+    , cachedir()
+    , condtree48()
+    , has48()
+    , same48()
+    , scankey()
+    , scancache()
+    , cmutex()
+    , scanned()
+    , scannedcnt()
+    , scanfull()
+    , streaming()
+    , streampath()
+    , stream()
+    , reader()
+    , smutex()
+    , snotfull()
+    , snotempty()
+    , chunks()
+    , seof()
+    , rhead(nullptr)
+    , rpending(0)
+    , statmutex()
+    , stats()
 {
     env.stop = &stop;
+    qRegisterMetaType< QVector<uint64_t> >("QVector<uint64_t>");
 }
 
 SearchMaster::~SearchMaster()
 {
     stopSearch();
+    takeResults(nullptr);
+}
+
+// Collect the enabled conditions of the top-level branches that have checks
+// on the lower 48 bits. Returns whether these are all of the conditions.
+static bool getBranches48(const std::vector<Condition>& cv, std::vector<Condition>& cv48)
+{
+    std::map<int, int> parent;
+    for (const Condition& c : cv)
+        if (!(c.meta & Condition::DISABLED))
+            parent[c.save] = c.relative;
+
+    auto branch = [&](int id) {
+        for (size_t depth = 0; depth < parent.size(); depth++)
+        {
+            auto it = parent.find(id);
+            if (it == parent.end() || it->second == 0)
+                break;
+            id = it->second;
+        }
+        return id;
+    };
+
+    std::set<int> keep;
+    for (const Condition& c : cv)
+    {
+        if (c.meta & Condition::DISABLED)
+            continue;
+        const FilterInfo& finfo = g_filterinfo.list[c.type];
+        if (!finfo.dep64 && finfo.cat != CAT_HELPER)
+            keep.insert(branch(c.save));
+    }
+
+    bool all = true;
+    cv48.clear();
+    for (const Condition& c : cv)
+    {
+        if (c.meta & Condition::DISABLED)
+            continue;
+        if (keep.count(branch(c.save)))
+            cv48.push_back(c);
+        else
+            all = false;
+    }
+    return all;
 }
 
 bool SearchMaster::set(QWidget *widget, const Session& s)
@@ -289,9 +386,26 @@ bool SearchMaster::set(QWidget *widget, const Session& s)
         }
     }
 
+    if (s.sc.shards < 1 || s.sc.shard < 0 || s.sc.shard >= s.sc.shards)
+    {
+        warn(widget, tr("Invalid part %1/%2 of the search space.").arg(s.sc.shard).arg(s.sc.shards));
+        return false;
+    }
+    bool streamed = (s.sc.searchtype == SEARCH_LIST && s.sc.liststream);
+    if (streamed && s.sc.shards > 1)
+    {
+        warn(widget, tr("A streamed seed list cannot be split into parts."));
+        return false;
+    }
+
     QString err = condtree.set(s.cv, s.wi.mc);
     if (err.isEmpty())
     {
+        // resume with a tuned plan (a stale plan does not match and is ignored)
+        if (!s.plan.isEmpty())
+            condtree.readPlan(s.plan);
+        for (std::vector<CondStats>& v : stats)
+            v.assign(condtree.condvec.size(), CondStats());
         err = env.init(s.wi.mc, s.wi.large, condtree);
     }
     if (!err.isEmpty())
@@ -300,21 +414,42 @@ bool SearchMaster::set(QWidget *widget, const Session& s)
         return false;
     }
 
+    std::vector<Condition> cv48;
+    this->same48 = getBranches48(s.cv, cv48);
+    this->has48 = !cv48.empty() && condtree48.set(cv48, s.wi.mc).isEmpty();
+    this->scankey.clear();
+    this->scancache = CandidateSet();
+    this->scanned.clear();
+    this->scannedcnt = 0;
+    this->scanfull = false;
+
     this->searchtype = s.sc.searchtype;
     this->mc = s.wi.mc;
     this->large = s.wi.large;
     this->itemsize = 1;
     this->threadcnt = s.sc.threads;
-    this->slist = s.slist;
+    if (s.slistfile.empty())
+        this->slist.assign(s.slist);
+    else
+        this->slist = s.slistfile;
     this->gen48 = s.gen48;
-    this->idx = 0;
+    this->streaming = streamed;
+    this->streampath = s.sc.slist64path;
+    this->stream.close();
+    this->idx = (s.sc.searchtype == SEARCH_LIST) ? s.sc.startidx : 0;
     this->scnt = ~(uint64_t)0;
     this->prog = 0;
     this->seed = s.sc.startseed;
     this->smin = s.sc.smin;
     this->smax = s.sc.smax;
+    this->shard = s.sc.shard;
+    this->shards = s.sc.shards;
+    this->leased = false;
+    this->completed.clear();
+    this->prepared = false;
     this->isdone = false;
     this->stop = false;
+    this->drain = false;
     return true;
 }
 
@@ -330,26 +465,44 @@ static void genQHBases(int qual, uint64_t salt, std::vector<uint64_t>& list48)
     case BARELY:  cst_type = CST_BARELY; break;
     }
 
+    // The resources hold the bases of each constellation, named by its lower
+    // 20 bits, as the varint encoded differences of the middle 28 bits. They
+    // are stored uncompressed, so that they can be mapped directly.
     QDirIterator it(":/qh");
     while (it.hasNext())
     {
         QString fnam = it.next();
-        printf("> %s\n", fnam.toLocal8Bit().data());
-        QFile file(fnam);
         uint64_t low = it.fileInfo().baseName().toUInt(nullptr, 16);
-        uint64_t mid = 0;
         if (getQuadHutCst(low) > cst_type)
             continue;
 
-        file.open(QIODevice::ReadOnly);
-        QTextStream stream(&file);
+        QFile file(fnam);
+        if (!file.open(QIODevice::ReadOnly))
+            continue;
+        QByteArray buf;
+        qint64 size = file.size();
+        const uchar *p = file.map(0, size);
+        if (!p)
+        {
+            buf = file.readAll();
+            p = (const uchar*) buf.constData();
+            size = buf.size();
+        }
+        const uchar *pe = p + size;
 
-        while (!stream.atEnd())
+        uint64_t mid = 0;
+        while (p < pe)
         {
-            QString line = stream.readLine();
-            uint64_t diff = line.toULongLong(nullptr, 16);
-            if (diff == 0)
-                break;
+            uint64_t diff = 0;
+            int shift = 0;
+            while (p < pe && shift < 64)
+            {
+                uchar b = *p++;
+                diff |= (uint64_t)(b & 0x7f) << shift;
+                shift += 7;
+                if (!(b & 0x80))
+                    break;
+            }
             mid += diff;
             uint64_t s48 = (mid << 20) + low;
             list48.push_back(s48 - salt);
@@ -357,41 +510,54 @@ static void genQHBases(int qual, uint64_t salt, std::vector<uint64_t>& list48)
     }
 }
 
-static bool applyTranspose(std::vector<uint64_t>& slist,
-        const Gen48Config& gen48, uint64_t bufmax)
+static bool applyTranspose(SeedList& seeds, const Gen48Config& gen48,
+        uint64_t add, uint64_t bufmax, SeedSorter& sorter)
 {
-    std::vector<uint64_t> list48;
-
     int x = gen48.x1;
     int z = gen48.z1;
     int w = gen48.x2 - x + 1;
     int h = gen48.z2 - z + 1;
 
-    // does the set of candidates for this condition fit in memory?
-    if ((uint64_t)slist.size() * sizeof(int64_t) * w*h >= bufmax)
+    // a sorted list without offsets is used as it is (and can stay mapped)
+    bool sorted48 = seeds.isSorted() && (seeds.empty() || seeds.back() <= MASK48);
+    if (w == 1 && h == 1 && ((moveStructure(0, x, z) + add) & MASK48) == 0 && sorted48)
+        return true;
+
+    std::vector<uint64_t> offsets;
+    for (int j = 0; j < h; j++)
+        for (int i = 0; i < w; i++)
+            offsets.push_back((moveStructure(0, x+i, z+j) + add) & MASK48);
+
+    // candidates that do not fit into the buffer are merged on the fly
+    if ((uint64_t)seeds.size() * sizeof(int64_t) * w*h >= bufmax)
     {
-        slist.clear();
-        return false;
+        if (!sorted48 && !sorter.sort(seeds))
+            return false;
+        try {
+            return seeds.transpose(offsets, sorter.progress);
+        } catch (...) {
+            seeds.clear();
+            return false;
+        }
     }
 
+    std::vector<uint64_t> list48;
     try {
-        list48.resize(slist.size() * w*h);
+        list48.resize(seeds.size() * w*h);
     } catch (...) {
-        slist.clear();
+        seeds.clear();
         return false;
     }
 
+    const CpuKernels& kern = getCpuKernels();
     uint64_t *p = list48.data();
-    for (int j = 0; j < h; j++)
-        for (int i = 0; i < w; i++)
-            for (uint64_t b : slist)
-                *p++ = moveStructure(b, x+i, z+j);
-
-    std::sort(list48.begin(), list48.end());
-    auto last = std::unique(list48.begin(), list48.end());
-    list48.erase(last, list48.end());
-    slist.swap(list48);
-    return !slist.empty();
+    for (uint64_t d : offsets)
+    {
+        kern.offsetSeeds(p, seeds.data(), seeds.size(), d);
+        p += seeds.size();
+    }
+    seeds.take(list48);
+    return sorter.sort(seeds) && !seeds.empty();
 }
 
 void SearchMaster::preSearch()
@@ -415,9 +581,29 @@ void SearchMaster::preSearch()
         }
     }
 
-    if (searchtype != SEARCH_LIST)
+    // the candidates are generated once per set(), so that the search can be
+    // restarted over different ranges
+    if (searchtype != SEARCH_LIST && !prepared)
     {
-        if (gen48.mode == GEN48_QH)
+        prepared = true;
+
+        // the generated candidates are cached with everything they depend on
+        QString genkey;
+        CandidateSet cs;
+        if (!cachedir.isEmpty() && (gen48.mode == GEN48_QH || gen48.mode == GEN48_QM))
+        {
+            genkey = getCandidateKey(QString::asprintf(
+                "gen48 %d %d %d %d %" PRIu64 " %d %d %d %d",
+                mc, gen48.mode, gen48.qual, gen48.qmarea,
+                gen48.qual == IDEAL_SALTED ? gen48.salt : 0,
+                gen48.x1, gen48.z1, gen48.x2, gen48.z2));
+        }
+        bool cached = !genkey.isEmpty() && loadCandidates(cachedir, genkey, &cs);
+        if (cached)
+        {
+            slist.take(cs.seeds, true);
+        }
+        else if (gen48.mode == GEN48_QH)
         {
             uint64_t salt = 0;
             if (gen48.qual == IDEAL_SALTED)
@@ -429,70 +615,143 @@ void SearchMaster::preSearch()
                 salt = sconf.salt;
             }
             slist.clear();
-            genQHBases(gen48.qual, salt, slist);
+            genQHBases(gen48.qual, salt, slist.edit());
         }
         else if (gen48.mode == GEN48_QM)
         {
             StructureConfig sconf;
             getStructureConfig_override(Monument, mc, &sconf);
-            slist.clear();
+            std::vector<uint64_t>& l = slist.edit();
+            l.clear();
             for (const uint64_t *s = g_qm_90; *s; s++)
                 if (qmonumentQual(*s) >= gen48.qmarea)
-                    slist.push_back((*s - sconf.salt) & MASK48);
+                    l.push_back((*s - sconf.salt) & MASK48);
         }
-        else if (gen48.mode == GEN48_LIST)
+
+        // the list salt is applied as part of the offsets
+        uint64_t add = 0;
+        if (gen48.mode == GEN48_LIST)
+            add = gen48.listsalt;
+
+        SeedSorter sorter;
+        sorter.threads = threadcnt;
+        sorter.budget = sortmem;
+        sorter.mask = MASK48;
+        sorter.progress = [this](double f) {
+            emit searchPrepare(f);
+            return !stop;
+        };
+        if (!cached && !slist.empty() && applyTranspose(slist, gen48, add, PRECOMPUTE48_BUFSIZ, sorter))
         {
-            if (gen48.listsalt)
+            emit searchPrepare(1);
+            // (a list that is merged on the fly is too large to be worth storing)
+            if (!genkey.isEmpty() && !stop && !slist.isTransposed())
             {
-                for (uint64_t& rs : slist)
-                    rs += gen48.listsalt;
+                cs.first = 0;
+                cs.end = MASK48 + 1;
+                cs.seeds.assign(slist.data(), slist.data() + slist.size());
+                saveCandidates(cachedir, genkey, cs);
             }
         }
 
-        if (!slist.empty())
-            applyTranspose(slist, gen48, PRECOMPUTE48_BUFSIZ);
+        // the viable bases of earlier block searches with the same 48-bit checks
+        if (searchtype == SEARCH_BLOCKS && slist.empty() && has48 && !cachedir.isEmpty())
+        {
+            QString spec = QString::asprintf("blocks %d %d", mc, large);
+            for (const Condition& c : condtree48.condvec)
+                if (c.type != F_SELECT)
+                    spec += " " + c.toHex();
+            scankey = getCandidateKey(spec);
+            if (!loadCandidates(cachedir, scankey, &scancache))
+                scancache = CandidateSet();
+        }
     }
 
-    if (searchtype == SEARCH_LIST)
+    // Each search type maps its search space onto the progress positions
+    // [prog, send), see seedAt() for the inverse.
+    sbegin = 0;
+    send = 0;
+    sfull = false;
+    lowmin = 0;
+
+    if (searchtype == SEARCH_LIST && streaming)
+    {   // position = byte offset in the list
+        if (stream.isOpen() || stream.open(streampath))
+        {
+            sbegin = stream.first();
+            send = stream.size();
+            prog = sstart < sbegin ? sbegin : sstart;
+            if (prog >= send)
+            {
+                prog = send;
+                isdone = true;
+            }
+        }
+        else
+        {
+            prog = sstart;
+            isdone = true;
+        }
+        seed = prog;
+        scnt = send - sbegin;
+        smax = send;
+        idx = 0;
+    }
+    else if (searchtype == SEARCH_LIST)
     {
         if (!slist.empty())
         {   // 64-bit seed list
+            // position = index in the list, which is saved with the seed, as
+            // a seed can appear more than once (index == size: done)
             scnt = slist.size();
-            for (idx = 0; idx < scnt; idx++)
-                if (slist[idx] == sstart)
-                    break;
-            if (idx == scnt)
-                idx = 0;
-            seed = slist[idx];
             smax = slist.back();
+            if (leased)
+                idx = 0; // (a lease sets its own start)
+            else if (idx > scnt || (idx < scnt ? slist[idx] : smax) != sstart)
+            {   // no index, or it does not match the seed (older sessions)
+                for (idx = 0; idx < scnt; idx++)
+                    if (slist[idx] == sstart)
+                        break;
+                if (idx == scnt)
+                    idx = 0;
+            }
             prog = idx;
+            send = scnt;
+            if (idx == scnt)
+            {
+                seed = smax;
+                isdone = true;
+            }
+            else
+                seed = slist[idx];
         }
         else
         {   // slist should not be empty for a meaningful list search
             scnt = smax = ~(uint64_t)0;
             prog = seed = sstart;
             idx = 0;
+            isdone = true;
         }
     }
 
     if (searchtype == SEARCH_48ONLY)
     {
         if (!slist.empty())
-        {   // 48-bit seed list
+        {   // 48-bit seed list (sorted)
             scnt = slist.size();
-            for (idx = 0; idx < scnt; idx++)
-                if (slist[idx] == sstart)
-                    break;
-            if (idx == scnt)
+            idx = slist.lowerBound(sstart);
+            if (idx == scnt || slist[idx] != sstart)
                 idx = 0;
             seed = slist[idx];
             smax = slist.back();
             prog = idx;
+            send = scnt;
         }
         else
         {
             prog = seed = sstart;
             scnt = smax = MASK48;
+            send = MASK48 + 1;
             if (seed > smax)
                 isdone = true;
         }
@@ -502,33 +761,33 @@ void SearchMaster::preSearch()
     {   // smin & smax are given by user
         if (!slist.empty())
         {   // incremental search with a 48-bit list (incl. quad-searches)
+            // position = (high - hmin) * len + idx - lowmin
             seed = sstart;
             if (seed < smin)
                 seed = smin;
-            scnt = 0x10000 * slist.size();
+            uint64_t len = slist.size();
             uint64_t high = (seed >> 48) & 0xffff;
-            for (idx = 0; idx < slist.size(); idx++)
-                if (slist[idx] >= (seed & MASK48))
-                    break;
-            if (idx == slist.size())
+            idx = slist.lowerBound(seed & MASK48);
+            if (idx == len)
             {
-                if (high++ >= (smax >> 48))
-                    isdone = true;
+                high++;
                 idx = 0;
             }
-            seed = (high << 48) | slist[idx];
             // trim the search space to the range [smin, smax]
-            uint64_t idxmin, idxmax;
-            for (idxmin = 0; idxmin < slist.size(); idxmin++)
-                if (slist[idxmin] >= (smin & MASK48))
-                    break;
-            for (idxmax = 0; idxmax < slist.size(); idxmax++)
-                if (slist[idxmax] >= (smax & MASK48))
-                    break;
-            high = (high - (smin >> 48)) & 0xffff;
-            prog = high * slist.size() + idx - idxmin;
-            high = ((smax >> 48) - (smin >> 48)) & 0xffff;
-            scnt = high * slist.size() + idxmax - idxmin;
+            lowmin = slist.lowerBound(smin & MASK48);
+            uint64_t lowend = slist.upperBound(smax & MASK48);
+            uint64_t hmin = smin >> 48;
+            uint64_t hmax = smax >> 48;
+            send = (hmax - hmin) * len + lowend - lowmin;
+            if (high > hmax)
+                prog = send;
+            else
+                prog = (high - hmin) * len + idx - lowmin;
+            if (prog >= send)
+                isdone = true;
+            else
+                seed = (high << 48) | slist[idx];
+            scnt = send;
         }
         else
         {   // simple incremental search
@@ -537,41 +796,220 @@ void SearchMaster::preSearch()
                 seed = smin;
             prog = seed - smin;
             scnt = smax - smin;
+            send = scnt + 1;
+            if (send == 0)
+            {   // the complete 64-bit range
+                send = ~(uint64_t)0;
+                sfull = true;
+            }
         }
         if (seed > smax)
             isdone = true;
     }
 
     if (searchtype == SEARCH_BLOCKS)
-    {
+    {   // position = (idx << 16) | high
         if (!slist.empty())
         {
             scnt = 0x10000 * slist.size();
-            for (idx = 0; idx < slist.size(); idx++)
-                if (slist[idx] >= (sstart & MASK48))
-                    break;
+            send = scnt;
+            uint64_t low = sstart & MASK48;
+            idx = slist.lowerBound(low);
             if (idx == slist.size())
                 isdone = true;
             else
             {
-                seed = (sstart & ~MASK48) | slist[idx];
+                if (slist[idx] == low)
+                    seed = sstart;
+                else
+                    seed = slist[idx];
                 prog = 0x10000 * idx + (seed >> 48);
             }
             smax = slist.back() | (0xffffULL << 48);
         }
         else
-        {
+        {   // the block of each low 48-bit base is preceded by a fast check
+            // position = (low << 16) | high
             scnt = smax = ~(uint64_t)0;
+            send = ~(uint64_t)0;
+            sfull = true;
             seed = sstart;
             prog = (seed << 16) | (seed >> 48);
         }
     }
+
+    if (leased && !isdone)
+    {
+        prog = lfirst;
+        applyRange(lfirst, llast);
+    }
+    else if (shards > 1 && !isdone)
+    {
+        applyShard();
+    }
+
+    bases = decltype(bases)();
+    queuemin = ~(uint64_t)0;
+    cursor = isdone ? send : prog;
+
+    if (!isdone && searchtype == SEARCH_BLOCKS && slist.empty() && (prog & 0xffff))
+    {   // resume within a block: the base was found viable already
+        uint64_t low = prog >> 16;
+        queueBase(prog);
+        cursor = (low == MASK48) ? send : (low + 1) << 16;
+    }
+}
+
+void SearchMaster::applyShard()
+{
+    // The progress positions are split evenly, which keeps the shards
+    // deterministic for every search type. A block search is split at whole
+    // 48-bit bases.
+    int bits = (searchtype == SEARCH_BLOCKS) ? 16 : 0;
+    // number of units in the search space (0 for the full 64-bit range)
+    uint64_t units = (send >> bits) + (sfull ? 1 : 0);
+    uint64_t q, r;
+    if (units)
+    {
+        q = units / shards;
+        r = units % shards;
+    }
+    else
+    {
+        q = ~(uint64_t)0 / shards;
+        r = ~(uint64_t)0 % shards + 1;
+        if (r == (uint64_t) shards)
+        {
+            q++;
+            r = 0;
+        }
+    }
+    uint64_t i = shard;
+    uint64_t lo = (i * q + (i < r ? i : r)) << bits;
+    uint64_t last = sfull ? send : send - 1;
+    if (shard + 1 < shards)
+    {   // the last shard keeps the end of the search space
+        i++;
+        uint64_t hi = (i * q + (i < r ? i : r)) << bits;
+        if (hi == lo)
+        {
+            sbegin = send = lo;
+            sfull = false;
+            scnt = 0;
+            isdone = true;
+            return;
+        }
+        last = hi - 1;
+    }
+    applyRange(lo, last);
+}
+
+void SearchMaster::applyRange(uint64_t first, uint64_t last)
+{
+    sbegin = first;
+    if (last < (sfull ? send : send - 1))
+    {
+        send = last + 1;
+        sfull = false;
+    }
+
+    if (prog < sbegin)
+        prog = sbegin;
+    if (prog >= send && !sfull)
+    {
+        prog = send;
+        isdone = true;
+    }
+    else
+    {
+        seed = seedAt(prog);
+    }
+    scnt = send - sbegin;
+}
+
+bool SearchMaster::setLease(uint64_t first, uint64_t last)
+{
+    if (streaming)
+    {
+        warn(nullptr, tr("A streamed seed list cannot be split into parts."));
+        return false;
+    }
+    leased = true;
+    lfirst = first;
+    llast = last;
+    // map the search space from its start
+    seed = 0;
+    isdone = false;
+    return true;
+}
+
+void SearchMaster::setCompleted(const std::map<uint64_t, uint64_t>& ranges)
+{
+    completed = ranges;
+}
+
+bool SearchMaster::skipCompleted(uint64_t *pos, uint64_t *lim) const
+{
+    // Advance 'pos' past a completed range, and lower 'lim' to the start of
+    // the next one. Returns false if no position from 'pos' on is pending.
+    auto it = completed.upper_bound(*pos);
+    if (it != completed.begin() && std::prev(it)->second >= *pos)
+    {
+        if (std::prev(it)->second == ~(uint64_t)0)
+            return false;
+        *pos = std::prev(it)->second + 1;
+    }
+    if (it != completed.end() && it->first < *lim)
+        *lim = it->first;
+    return true;
+}
+
+bool SearchMaster::isCompleted(uint64_t first, uint64_t last) const
+{
+    auto it = completed.upper_bound(first);
+    return it != completed.begin() && std::prev(it)->second >= last;
+}
+
+uint64_t SearchMaster::getPosition()
+{
+    return isdone ? send : lowestPending();
+}
+
+uint64_t SearchMaster::seedAt(uint64_t pos, const uint64_t *entry) const
+{
+    if (streaming)
+        return pos; // the seeds are not known ahead
+    uint64_t len = slist.size();
+    switch (searchtype)
+    {
+    case SEARCH_LIST:
+        if (len)
+            return entry ? *entry : slist[pos < len ? pos : len-1];
+        return pos;
+    case SEARCH_48ONLY:
+        if (len)
+            return entry ? *entry : slist[pos < len ? pos : len-1];
+        return pos;
+    case SEARCH_INC:
+        if (len)
+        {
+            pos += lowmin;
+            return (((smin >> 48) + pos / len) << 48) | (entry ? *entry : slist[pos % len]);
+        }
+        return smin + pos;
+    case SEARCH_BLOCKS:
+        if (len)
+            return ((pos & 0xffff) << 48) | (entry ? *entry : slist[(pos >> 16) < len ? (pos >> 16) : len-1]);
+        return ((pos & 0xffff) << 48) | (pos >> 16);
+    }
+    return 0;
 }
 
 void SearchMaster::startSearch()
 {
     stopSearch();
     stop = false;
+    drain = false;
     preSearch();
 
     if (stop)
@@ -580,13 +1018,27 @@ void SearchMaster::startSearch()
         return;
     }
 
+    if (streaming && !isdone)
+    {   // (the standard input cannot go back for a restart)
+        chunks.clear();
+        seof = false;
+        queuemin = ~(uint64_t)0;
+        if (!stream.seek(prog))
+        {
+            warn(nullptr, tr("Failed to continue the seed list at offset %1.").arg(prog));
+            emit searchFinish(false);
+            return;
+        }
+        reader = new StreamReader(this);
+    }
+
     for (int i = 0; i < threadcnt; i++)
     {
         SearchWorker *worker = new SearchWorker(this);
         QObject::connect(
-            worker, &SearchWorker::result,
-            this, &SearchMaster::onWorkerResult,
-            Qt::BlockingQueuedConnection);
+            worker, &SearchWorker::resultsReady,
+            this, &SearchMaster::onWorkerResults,
+            Qt::QueuedConnection);
         QObject::connect(
             worker, &SearchWorker::finished,
             this, &SearchMaster::onWorkerFinished,
@@ -599,18 +1051,21 @@ void SearchMaster::startSearch()
 
     proghist.clear();
     progtimer.start();
-    itemtimer.start();
-    count = 0;
+    version = 0;
+    transfers = 0;
 
     for (SearchWorker *worker : workers)
     {
         worker->start();
     }
+    if (reader)
+        reader->start();
 }
 
 void SearchMaster::stopSearch()
 {
     stop = true;
+    joinReader();
     if (workers.empty())
         return;
 
@@ -618,29 +1073,57 @@ void SearchMaster::stopSearch()
     QElapsedTimer timer;
     timer.start();
 
-    while (timer.elapsed() < stop_ms)
+    bool busy = true;
+    while (busy && timer.elapsed() < stop_ms)
     {
-        bool busy = false;
+        busy = false;
         for (SearchWorker *worker : workers)
             busy |= worker->isRunning();
-        if (!busy)
-            break;
-        QThread::msleep(10);
+        if (busy)
+            QThread::msleep(10);
     }
 
-    for (SearchWorker *worker : workers)
-    {
-        worker->disconnect(this);
-        if (worker->isRunning())
-            connect(worker, &SearchWorker::finished, worker, &QObject::deleteLater);
-        else
-            delete worker;
+    {   // the remaining workers must not steal from a deleted worker
+        QMutexLocker locker(&mutex);
+        holdTransfers();
+        for (SearchWorker *worker : workers)
+        {
+            worker->disconnect(this);
+            if (worker->isRunning())
+                connect(worker, &SearchWorker::finished, worker, &QObject::deleteLater);
+            else
+                delete worker;
+        }
+        workers.clear();
+        frozen = false;
     }
-    workers.clear();
 
+    // (a worker that is still running may use the cached bases)
+    if (!busy)
+        saveScanCache();
+    flushResults();
     emit searchFinish(false);
 }
 
+void SearchMaster::joinReader()
+{
+    if (!reader)
+        return;
+    // the reader waits with a timeout, but a read from a pipe may block
+    reader->wait(1000);
+    if (reader->isRunning())
+        connect(reader, &QThread::finished, reader, &QObject::deleteLater);
+    else
+        delete reader;
+    reader = nullptr;
+}
+
+void SearchMaster::drainSearch()
+{
+    // the workers exit once they have completed their current items
+    drain = true;
+}
+
 
 static QString getAbbrNum(double x)
 {
@@ -653,42 +1136,94 @@ static QString getAbbrNum(double x)
     return QString::asprintf("%.2f", x);
 }
 
-bool SearchMaster::getProgress(QString *status, uint64_t *prog, uint64_t *end, uint64_t *seed, qreal *min, qreal *avg, qreal *max)
+void SearchMaster::beginTransfer()
 {
-    if (!mutex.tryLock(10))
-    {
-        if (searchtype == SEARCH_BLOCKS && slist.empty())
-        {   // a block search with no list looks for candidates in the search
-            // master and can therefore make progress outside of workers
-            *prog = this->prog;
-            *end  = this->scnt;
-            *seed = this->seed;
-            return true;
-        }
-        return false;
+    transfers++;
+    if (frozen)
+    {   // wait until the master has read a consistent view
+        transfers--;
+        QMutexLocker locker(&mutex);
+        transfers++;
     }
-    *prog = this->prog;
-    *end  = this->scnt;
-    *seed = this->seed;
-    *min = *avg = *max = nan("");
+}
+
+void SearchMaster::holdTransfers()
+{
+    // New transfers wait for 'mutex' while 'frozen' is set, and the pending
+    // ones are short, so this does not wait for long.
+    frozen = true;
+    while (transfers)
+        QThread::yieldCurrentThread();
+}
 
-    bool valid = false;
+uint64_t SearchMaster::scanPending()
+{
+    uint64_t low = cursor;
+    uint64_t q = queuemin;
+    if (q < low)
+        low = q;
     for (SearchWorker *worker: workers)
     {
-        if (worker->prog < *prog)
+        uint64_t p = worker->prog;
+        if (p < low)
+            low = p;
+    }
+    return low;
+}
+
+uint64_t SearchMaster::lowestPending()
+{
+    // The lowest position that is still pending is the minimum over the
+    // unassigned space, the queued bases and the current items of the
+    // workers. Transfers move ranges between these, so we retry a few times
+    // until we get a consistent view, and otherwise hold off the transfers.
+    uint64_t low = 0;
+    bool ok = false;
+    for (int i = 0; i < PENDING_RETRIES && !ok; i++)
+    {
+        uint64_t ver = version;
+        if (transfers)
         {
-            *prog = worker->prog;
-            *seed = worker->seed;
-            valid = true;
+            QThread::yieldCurrentThread();
+            continue;
         }
+        low = scanPending();
+        ok = !transfers && ver == version;
+    }
+    if (!ok)
+    {
+        QMutexLocker locker(&mutex);
+        holdTransfers();
+        low = scanPending();
+        frozen = false;
     }
+    return low < send ? low : send;
+}
+
+bool SearchMaster::getProgress(QString *status, uint64_t *prog, uint64_t *end, uint64_t *seed, qreal *min, qreal *avg, qreal *max)
+{
+    uint64_t pos = lowestPending();
+    *prog = pos - sbegin;
+    *end  = this->scnt;
+    *seed = pos < send ? seedAt(pos) : smax;
+    *min = *avg = *max = nan("");
+
+    bool valid = !workers.empty();
+    int isize = 0;
+    for (SearchWorker *worker: workers)
+        isize += worker->itemsize;
+    if (valid)
+        isize /= (int) workers.size();
 
     if (isdone)
     {
         *prog = this->scnt;
     }
-
-    mutex.unlock();
+    else if (searchtype == SEARCH_INC && slist.empty())
+    {   // the range [smin, smax] has one more position than its reported size
+        if (*prog > this->scnt)
+            *prog = this->scnt;
+    }
 
     // track the progress over a few seconds so we can estimate the search speed
     enum { SAMPLE_SEC = 20 };
@@ -759,7 +1294,7 @@ bool SearchMaster::getProgress(QString *status, uint64_t *prog, uint64_t *end, u
         .arg(getAbbrNum(*avg), -8)
         .arg(getAbbrNum(*min), -8)
         .arg(getAbbrNum(*max), -8)
-        .arg(itemsize, -3)
+        .arg(isize, -3)
         .arg(eta);
 
     return valid;
@@ -767,136 +1302,669 @@ bool SearchMaster::getProgress(QString *status, uint64_t *prog, uint64_t *end, u
 
 bool SearchMaster::requestItem(SearchWorker *item)
 {
-    if (isdone)
-        return false;
-
-    // QMutexLocker locker(&mutex);
-
-    // check if we should adjust the item size
-    uint64_t nsec = itemtimer.nsecsElapsed();
-    count++;
-    if (nsec > 0.1e9)
+    // adjust the item size, aiming for a few milliseconds per item
+    uint64_t nsec = item->itemtimer.nsecsElapsed();
+    if (item->scnt > 0)
     {
-        if (count < 1e2 && itemsize > 1)
-            itemsize /= 2;
-        if (count > 1e3 && itemsize < 0x10000)
-            itemsize *= 2;
-        itemtimer.start();
-        count = 0;
+        if (nsec > 10e6 && item->itemsize > 1)
+            item->itemsize /= 2;
+        else if (nsec < 1e6 && item->itemsize < 0x10000 && item->scnt >= item->itemsize)
+            item->itemsize *= 2;
     }
+    item->scnt = 0;
 
-    item->prog      = prog;
-    item->idx       = idx;
-    item->sstart    = seed;
-    item->scnt      = itemsize;
-    item->seed      = seed;
-
-    prog += itemsize;
-
-    if (searchtype == SEARCH_LIST)
+    if (streaming)
     {
-        if (idx + itemsize > scnt)
-            item->scnt = scnt - idx;
-        idx += itemsize;
-        if (idx >= scnt)
-            isdone = true;
+        if (claimChunk(item))
+            return true;
+        item->prog = ~(uint64_t)0;
+        return false;
     }
 
-    if (searchtype == SEARCH_48ONLY)
+    while (!stop && !drain)
     {
-        if (!slist.empty())
-        {
-            if (idx + itemsize > scnt)
-                item->scnt = scnt - idx;
-            idx += itemsize;
-            if (idx >= scnt)
-                isdone = true;
+        // Claim an item from the owned range. Only the owning thread advances
+        // 'next', but a thief may lower 'end' at the same time: the thief
+        // publishes the new end before it reads 'next', while we publish 'next'
+        // before we read the end, so at least one side sees the other's claim.
+        uint64_t n = item->next;
+        uint64_t e = item->end;
+        uint64_t lim = e;
+        bool atend = false; // (only the final position 'send' is left)
+        if (n < e && !completed.empty())
+        {   // the positions that a resumed search has completed are skipped
+            if (!skipCompleted(&n, &lim))
+                n = e;
+            else
+                atend = (sfull && n == send && e == send);
         }
-        else
+        if (n < e || atend)
         {
-            seed += itemsize;
-            if (seed > MASK48)
-                isdone = true;
+            uint64_t k = item->itemsize;
+            if (searchtype == SEARCH_BLOCKS)
+            {   // items do not cross into the next 48-bit base
+                uint64_t rem = 0x10000 - (n & 0xffff);
+                if (k > rem)
+                    k = rem;
+            }
+            else if (searchtype == SEARCH_INC && slist.isTransposed())
+            {   // items do not wrap around the end of a merged list
+                uint64_t rem = slist.size() - (n + lowmin) % slist.size();
+                if (k > rem)
+                    k = rem;
+            }
+            uint64_t ne = (lim - n <= k) ? lim : n + k;
+            item->prog = n;
+            item->next = ne;
+            uint64_t e2 = item->end;
+            if (e2 < ne)
+            {   // a thief is taking part of our range, resolve under its lock
+                QMutexLocker locker(&item->stealmutex);
+                e2 = item->end;
+                if (e2 < ne)
+                    ne = e2 > n ? e2 : n;
+            }
+            if (ne > n || (atend && e2 == send))
+            {
+                uint64_t cnt = ne - n;
+                if (sfull && ne == send && (completed.empty() || !isCompleted(send, send)))
+                    cnt++; // the final position of the search space
+                item->ipos      = n;
+                item->ilast     = n + cnt - 1;
+                item->scnt      = (int) cnt;
+                if (searchtype == SEARCH_INC && !slist.empty())
+                    item->idx   = (n + lowmin) % slist.size();
+                else if (searchtype == SEARCH_BLOCKS && !slist.empty())
+                    item->idx   = n >> 16;
+                else
+                    item->idx   = n;
+                if (slist.isTransposed())
+                {   // the window holds the entry of the first position
+                    readWindow(item);
+                    item->sstart = seedAt(n, item->len ? item->slist : NULL);
+                }
+                else
+                {
+                    item->sstart = seedAt(n);
+                }
+                item->seed      = item->sstart;
+                item->itemtimer.start();
+                return true;
+            }
         }
+
+        // the owned range is exhausted => take a new span, or steal one
+        if (claimSpan(item))
+            continue;
+        if (stealSpan(item))
+            continue;
+        break;
     }
 
-    if (searchtype == SEARCH_INC)
-    {
-        if (!slist.empty())
-        {
-            uint64_t high = (seed >> 48) & 0xffff;
-            idx += itemsize;
-            high += idx / slist.size();
-            idx %= slist.size();
-            seed = (high << 48) | slist[idx];
-            if (high > (smax >> 48))
-                isdone = true;
+    item->prog = ~(uint64_t)0;
+    return false;
+}
+
+void SearchMaster::readWindow(SearchWorker *item)
+{
+    // the worker gets the candidates of its item from a merged list
+    uint64_t n = item->scnt;
+    if (searchtype == SEARCH_BLOCKS)
+        n = 1;
+    item->merge.read(slist, item->idx, n, item->chunk);
+    item->slist = item->chunk.data();
+    item->len   = item->chunk.size();
+    item->idx   = 0;
+}
+
+bool SearchMaster::claimSpan(SearchWorker *item)
+{
+    // Everything below the cursor is owned by some worker, so we must not
+    // release our progress position before we own the new span.
+    uint64_t c = cursor;
+    item->prog = c;
+
+    if (searchtype == SEARCH_BLOCKS && slist.empty())
+        return claimBase(item);
+
+    uint64_t span = (uint64_t) item->itemsize * SPAN_ITEMS;
+    while (c < send)
+    {
+        uint64_t e = (send - c <= span) ? send : c + span;
+        uint64_t p = c, lim = e;
+        if (!completed.empty() && !(skipCompleted(&p, &lim) && p == c))
+        {   // a completed range is claimed at once, requestItem() skips it
+            e = (p > c && p < send) ? p : send;
         }
-        else
+        if (cursor.compare_exchange_weak(c, e))
         {
-            // seed += itemsize; with overflow detection
-            uint64_t s = seed + itemsize;
-            if (s < seed)
-                isdone = true; // overflow
-            seed = s;
+            item->setRange(c, e);
+            item->prog = c;
+            return true;
         }
-        if (seed > smax)
-            isdone = true;
+        item->prog = c;
     }
+    return false;
+}
 
-    if (searchtype == SEARCH_BLOCKS)
+void SearchMaster::queueBase(uint64_t pos)
+{
+    beginTransfer();
+    qmutex.lock();
+    bases.push(pos);
+    if (pos < queuemin)
+        queuemin = pos;
+    qmutex.unlock();
+    version++;
+    transfers--;
+}
+
+bool SearchMaster::claimBase(SearchWorker *item)
+{
+    while (!stop && !drain)
     {
-        if (!slist.empty())
+        // expand the lowest viable base that is waiting in the queue
+        bool ok = false;
+        beginTransfer();
+        qmutex.lock();
+        if (!bases.empty())
         {
-            uint64_t high = (seed >> 48) & 0xffff;
-            high += itemsize;
-            if (high >= 0x10000)
+            uint64_t pos = bases.top();
+            uint64_t low = pos >> 16;
+            bases.pop();
+            item->prog = pos;
+            queuemin = bases.empty() ? ~(uint64_t)0 : bases.top();
+            item->setRange(pos, (low == MASK48) ? send : (low + 1) << 16);
+            ok = true;
+        }
+        qmutex.unlock();
+        version++;
+        transfers--;
+        if (ok)
+            return true;
+
+        // otherwise, produce more bases by scanning the next chunk
+        uint64_t c = cursor;
+        uint64_t e;
+        bool scan;
+        while (true)
+        {
+            item->prog = c;
+            if (c >= send)
+                return false;
+            uint64_t span = (uint64_t) SCAN_CHUNK << 16;
+            e = (send - c <= span) ? send : c + span;
+            scan = true;
+            uint64_t p = c, lim = e;
+            if (!completed.empty())
+            {   // the whole bases that a resumed search has completed are
+                // passed over without a scan
+                uint64_t pe = c;
+                if (!skipCompleted(&p, &lim))
+                    pe = send;
+                else if (p > c)
+                    pe = (p < send || (sfull && p == send)) ? p & ~0xffffULL : send;
+                if (pe > c)
+                {
+                    e = pe;
+                    scan = false;
+                }
+            }
+            if (cursor.compare_exchange_weak(c, e))
+                break;
+        }
+        if (!scan)
+            continue;
+
+        uint64_t low = c >> 16;
+        uint64_t lend = (e == send && sfull) ? MASK48 : (e >> 16) - 1;
+        if (!scanBases(item, low, lend))
+            return false;
+    }
+    return false;
+}
+
+bool SearchMaster::scanBases(SearchWorker *item, uint64_t low, uint64_t lend)
+{
+    Pos origin = {0,0};
+    SearchThreadEnv *env = &item->env;
+    SearchThreadEnv *env48 = same48 ? &item->env : &item->env48;
+    bool record = !scankey.isEmpty();
+
+    // the newly scanned bases are kept as a run for the cache
+    CandidateSet run;
+    run.first = run.end = low;
+
+    for (; low <= lend; low++)
+    {
+        if (stop || drain)
+            break;
+        item->prog = low << 16;
+
+        if (low >= scancache.first && low < scancache.end)
+        {   // skip to the next cached base
+            if (run.end > run.first)
+                recordScan(run);
+            const std::vector<uint64_t>& v = scancache.seeds;
+            auto it = std::lower_bound(v.begin(), v.end(), low);
+            uint64_t next = (it == v.end()) ? scancache.end : *it;
+            if (next > lend)
+                next = lend + 1;
+            if (next > low)
             {
-                high = 0;
-                idx++;
+                item->addDone(low << 16, ((next - 1) << 16) | 0xffff);
+                low = next - 1;
             }
-            if (idx >= slist.size())
-                isdone = true;
+            else if (same48)
+                queueBase(low << 16);
             else
-                seed = (high << 48) | slist[idx];
+            {
+                env->setSeed(low);
+                if (testTreeAt(origin, env, PASS_FAST_48, nullptr) != COND_FAILED)
+                    queueBase(low << 16);
+                else
+                    item->addDone(low << 16, (low << 16) | 0xffff);
+            }
+            run.first = run.end = low + 1;
+            continue;
+        }
+
+        bool viable;
+        if (record)
+        {   // the cached checks come first, the rest of the tree after
+            env48->setSeed(low);
+            viable = testTreeAt(origin, env48, PASS_FAST_48, nullptr) != COND_FAILED;
+            if (viable)
+                run.seeds.push_back(low);
+            run.end = low + 1;
+            if (viable && !same48)
+            {
+                env->setSeed(low);
+                viable = testTreeAt(origin, env, PASS_FAST_48, nullptr) != COND_FAILED;
+            }
         }
         else
         {
-            Pos origin = {0,0};
-            uint64_t high = (seed >> 48) & 0xffff;
-            uint64_t low = seed & MASK48;
-            high += itemsize;
-            if (high >= 0x10000)
+            env->setSeed(low);
+            viable = testTreeAt(origin, env, PASS_FAST_48, nullptr) != COND_FAILED;
+        }
+        if (viable)
+            queueBase(low << 16);
+        else
+            item->addDone(low << 16, (low << 16) | 0xffff);
+    }
+
+    if (record && run.end > run.first)
+        recordScan(run);
+    return !stop && !drain;
+}
+
+void SearchMaster::recordScan(CandidateSet& run)
+{
+    QMutexLocker locker(&cmutex);
+    if (!scanfull)
+    {
+        scannedcnt += run.seeds.size();
+        if (scannedcnt > SCAN_CACHE_MAX)
+        {   // too many viable bases to be worth caching
+            scanfull = true;
+            scanned.clear();
+        }
+        else
+            scanned[run.first] = std::move(run);
+    }
+    run = CandidateSet();
+}
+
+void SearchMaster::saveScanCache()
+{
+    if (scankey.isEmpty())
+        return;
+    QMutexLocker locker(&cmutex);
+    if (scanfull || scanned.empty())
+        return;
+
+    // the cache holds one contiguous range of scanned bases
+    bool changed = false;
+    if (scancache.first == scancache.end)
+    {
+        scancache = std::move(scanned.begin()->second);
+        scanned.erase(scanned.begin());
+        changed = true;
+    }
+    while (!scanned.empty())
+    {
+        auto it = scanned.find(scancache.end);
+        if (it != scanned.end())
+        {   // append a run
+            std::vector<uint64_t>& v = it->second.seeds;
+            scancache.seeds.insert(scancache.seeds.end(), v.begin(), v.end());
+            scancache.end = it->second.end;
+            scanned.erase(it);
+            changed = true;
+            continue;
+        }
+        it = scanned.lower_bound(scancache.first);
+        if (it != scanned.begin() && (--it)->second.end == scancache.first)
+        {   // prepend a run
+            std::vector<uint64_t>& v = it->second.seeds;
+            scancache.seeds.insert(scancache.seeds.begin(), v.begin(), v.end());
+            scancache.first = it->second.first;
+            scanned.erase(it);
+            changed = true;
+            continue;
+        }
+        break;
+    }
+    if (changed)
+        saveCandidates(cachedir, scankey, scancache);
+}
+
+bool SearchMaster::claimChunk(SearchWorker *item)
+{
+    QMutexLocker locker(&smutex);
+    while (true)
+    {
+        while (chunks.empty() && !seof && !stop && !drain)
+            snotempty.wait(&smutex, 100);
+        if (chunks.empty() || stop || drain)
+            return false;
+        const StreamChunk& c = chunks.front();
+        if (completed.empty() || !isCompleted(c.begin, c.end - 1))
+            break;
+        // a chunk that a resumed search has completed is dropped
+        beginTransfer();
+        chunks.pop_front();
+        queuemin = chunks.empty() ? ~(uint64_t)0 : chunks.front().begin;
+        version++;
+        transfers--;
+        snotfull.wakeOne();
+    }
+
+    // the worker owns the seeds of its chunk until it asks for the next one
+    beginTransfer();
+    StreamChunk& c = chunks.front();
+    item->prog = c.begin;
+    item->ipos = c.begin;
+    item->ilast = c.end - 1;
+    item->chunk.swap(c.seeds);
+    chunks.pop_front();
+    queuemin = chunks.empty() ? ~(uint64_t)0 : chunks.front().begin;
+    version++;
+    transfers--;
+    snotfull.wakeOne();
+
+    item->slist     = item->chunk.data();
+    item->len       = item->chunk.size();
+    item->idx       = 0;
+    // (a chunk without seeds still completes its range)
+    item->scnt      = item->len ? (int) item->len : 1;
+    item->sstart    = item->len ? item->chunk[0] : 0;
+    item->seed      = item->sstart;
+    item->itemtimer.start();
+    return true;
+}
+
+void SearchMaster::readStream()
+{
+    while (!stop && !drain)
+    {
+        StreamChunk c;
+        c.begin = stream.offset();
+        c.end = c.begin + stream.read(c.seeds, STREAM_CHUNK);
+
+        QMutexLocker locker(&smutex);
+        while (chunks.size() >= STREAM_QUEUE && !stop && !drain)
+            snotfull.wait(&smutex, 100);
+        if (stop || drain)
+            break;
+        beginTransfer();
+        if (c.end == c.begin)
+        {   // end of the list
+            seof = true;
+            cursor = send;
+        }
+        else
+        {
+            if (chunks.empty())
+                queuemin = c.begin;
+            cursor = c.end;
+            chunks.push_back(StreamChunk());
+            std::swap(chunks.back(), c);
+        }
+        version++;
+        transfers--;
+        snotempty.wakeAll();
+        if (seof)
+            break;
+    }
+    // wake the workers that wait for chunks
+    QMutexLocker locker(&smutex);
+    snotempty.wakeAll();
+}
+
+bool SearchMaster::stealSpan(SearchWorker *item)
+{
+    bool ok = false;
+    while (!ok)
+    {
+        // the worker list stays valid while a steal is in progress
+        beginTransfer();
+        if (stop || drain)
+        {
+            transfers--;
+            break;
+        }
+
+        SearchWorker *victim = nullptr;
+        uint64_t remmax = 1;
+        for (SearchWorker *worker : workers)
+        {
+            if (worker == item)
+                continue;
+            uint64_t n = worker->next;
+            uint64_t e = worker->end;
+            if (n < e && e - n > remmax)
             {
-                item->scnt -= 0x10000 - high;
-                high = 0;
-                low++;
+                remmax = e - n;
+                victim = worker;
+            }
+        }
+        if (!victim)
+        {
+            transfers--;
+            break;
+        }
 
-                for (; low <= MASK48 && !stop; low++)
-                {
-                    env.setSeed(low);
-                    if (testTreeAt(origin, &env, PASS_FAST_48, nullptr)
-                        != COND_FAILED)
-                    {
-                        break;
-                    }
-                    // update progress for skipped block
-                    seed = low;
-                    prog += 0x10000;
-                }
-                if (low > MASK48)
-                    isdone = true;
+        QMutexLocker locker(&victim->stealmutex);
+        uint64_t n = victim->next;
+        uint64_t e = victim->end;
+        if (n < e && e - n > 1)
+        {
+            // Lower the end of the victim's range first and only then check
+            // how far the owner has advanced in the meantime.
+            uint64_t mid = n + (e - n) / 2;
+            item->prog = mid;
+            victim->end = mid;
+            n = victim->next;
+            if (n < mid)
+                n = mid;
+            if (n < e)
+            {
+                victim->end = n;
+                item->setRange(n, e);
+                item->prog = n;
+                ok = true;
+            }
+            else
+            {
+                victim->end = e;
             }
-            seed = (high << 48) | low;
         }
+        locker.unlock();
+        version++;
+        transfers--;
     }
+    return ok;
+}
 
-    return true;
+bool SearchMaster::pushResults(std::vector<uint64_t>& seeds, std::vector<uint64_t>& pos, std::vector<uint64_t>& done)
+{
+    ResultBatch *batch = new ResultBatch;
+    batch->seeds.swap(seeds);
+    batch->pos.swap(pos);
+    batch->done.swap(done);
+    rpending += batch->seeds.size();
+    batch->next = rhead.load(std::memory_order_relaxed);
+    while (!rhead.compare_exchange_weak(batch->next, batch,
+        std::memory_order_release, std::memory_order_relaxed))
+    {
+    }
+    return batch->next == nullptr;
+}
+
+QVector<uint64_t> SearchMaster::takeResults(QVector<uint64_t> *done, QVector<uint64_t> *pos)
+{
+    // take the whole stack at once and restore the order of the batches
+    ResultBatch *batch = rhead.exchange(nullptr, std::memory_order_acquire);
+    ResultBatch *prev = nullptr;
+    size_t n = 0;
+    while (batch)
+    {
+        ResultBatch *next = batch->next;
+        batch->next = prev;
+        prev = batch;
+        n += batch->seeds.size();
+        batch = next;
+    }
+    QVector<uint64_t> seeds;
+    seeds.reserve(n);
+    for (batch = prev; batch; batch = prev)
+    {
+        for (uint64_t s : batch->seeds)
+            seeds.append(s);
+        if (pos)
+        {
+            for (uint64_t p : batch->pos)
+                pos->append(p);
+        }
+        if (done)
+        {
+            for (uint64_t d : batch->done)
+                done->append(d);
+        }
+        prev = batch->next;
+        delete batch;
+    }
+    rpending -= n;
+    return seeds;
 }
 
-void SearchMaster::onWorkerResult(uint64_t seed)
+void SearchMaster::flushResults()
 {
-    emit searchResult(seed);
+    QVector<uint64_t> done, pos;
+    QVector<uint64_t> seeds = takeResults(&done, &pos);
+    if (!seeds.empty())
+        emit searchResults(seeds, pos);
+    // after the results, so a receiver never sees a range before its results
+    if (!done.empty())
+        emit searchCheckpoint(done);
+}
+
+void SearchMaster::mergeStats(SearchWorker *item)
+{
+    QMutexLocker locker(&statmutex);
+    for (int pass = PASS_FAST_48; pass <= PASS_FULL_64; pass++)
+    {
+        std::vector<CondStats>& src = item->env.stats[pass];
+        std::vector<CondStats>& dst = stats[pass];
+        for (size_t i = 0; i < src.size() && i < dst.size(); i++)
+        {
+            dst[i].evals += src[i].evals;
+            dst[i].passes += src[i].passes;
+            dst[i].maybes += src[i].maybes;
+            dst[i].fails += src[i].fails;
+            dst[i].timed += src[i].timed;
+            dst[i].ns += src[i].ns;
+            dst[i].selfns += src[i].selfns;
+            src[i] = CondStats();
+        }
+    }
+    condtree.optimize(mc, stats);
+    for (int pass = PASS_FAST_48; pass <= PASS_FULL_64; pass++)
+        item->env.condtree.plan[pass] = condtree.plan[pass];
+    item->env.condtree.link();
+}
+
+QString SearchMaster::getPlan()
+{
+    QMutexLocker locker(&statmutex);
+    return condtree.planString();
+}
+
+void SearchMaster::getStats(std::vector<CondStats> *stats)
+{
+    QMutexLocker locker(&statmutex);
+    for (int pass = PASS_FAST_48; pass <= PASS_FULL_64; pass++)
+        stats[pass] = this->stats[pass];
+}
+
+static QString getAbbrTime(double ns)
+{
+    if (ns >= 10e9)
+        return QString::asprintf("%.1fs", ns * 1e-9);
+    if (ns >= 10e6)
+        return QString::asprintf("%.1fms", ns * 1e-6);
+    if (ns >= 10e3)
+        return QString::asprintf("%.1fus", ns * 1e-3);
+    return QString::asprintf("%.0fns", ns);
+}
+
+QStringList SearchMaster::getProfile()
+{
+    std::vector<CondStats> stats[PASS_FULL_64+1];
+    getStats(stats);
+
+    // per pass: evaluations, passed, undecided and failed share, and the
+    // average time without and with the branches
+    enum { PASS_WIDTH = 52 };
+    QStringList l;
+    l += QString("%1 %2 %3 %4").arg("cond", -4)
+        .arg(tr("fast 48-bit"), -PASS_WIDTH).arg(tr("full 48-bit"), -PASS_WIDTH)
+        .arg(tr("full 64-bit"), -PASS_WIDTH);
+    for (const Condition& c : condtree.condvec)
+    {
+        if (c.save == 0)
+            continue;
+        QString line = QString::asprintf("[%02d]", c.save);
+        for (int pass = PASS_FAST_48; pass <= PASS_FULL_64; pass++)
+        {
+            CondStats cs = {};
+            if (c.save < (int) stats[pass].size())
+                cs = stats[pass][c.save];
+            if (cs.evals == 0)
+            {
+                line += QString(" %1").arg("-", -PASS_WIDTH);
+                continue;
+            }
+            double self = cs.timed ? cs.selfns / (double) cs.timed : 0;
+            double avg = cs.timed ? cs.ns / (double) cs.timed : 0;
+            line += QString(" %1 %2% %3% %4% %5 %6")
+                .arg(getAbbrNum(cs.evals), 8)
+                .arg(100.0 * cs.passes / cs.evals, 6, 'f', 2)
+                .arg(100.0 * cs.maybes / cs.evals, 6, 'f', 2)
+                .arg(100.0 * cs.fails / cs.evals, 6, 'f', 2)
+                .arg(getAbbrTime(self), 9)
+                .arg(getAbbrTime(avg), 9);
+        }
+        l += line;
+    }
+    return l;
+}
+
+void SearchMaster::onWorkerResults()
+{
+    flushResults();
 }
 
 void SearchMaster::onWorkerFinished()
@@ -907,9 +1975,14 @@ void SearchMaster::onWorkerFinished()
     for (SearchWorker *worker : workers)
         if (!worker->isFinished())
             return;
+    if (!stop && !drain && cursor >= send)
+        isdone = true; // all work items completed
+    joinReader();
     for (SearchWorker *worker: workers)
         delete worker;
     workers.clear();
+    saveScanCache();
+    flushResults();
     emit searchFinish(isdone && !stop);
 }
 
@@ -917,183 +1990,246 @@ void SearchMaster::onWorkerFinished()
 SearchWorker::SearchWorker(SearchMaster *master)
     : QThread(nullptr)
     , master(master)
+    , stealmutex()
+    , itemtimer()
+    , stattimer()
+    , donetimer()
 {
-    this->slist         = master->slist.empty() ? NULL : master->slist.data();
+    // (the window of a merged list is read per item)
+    this->slist         = master->slist.isTransposed() ? NULL : master->slist.data();
     this->len           = master->slist.size();
 
+    this->next          = 0;
+    this->end           = 0;
+    this->itemsize      = master->itemsize;
+
     this->prog          = master->prog;
+    this->ipos          = master->prog;
+    this->ilast         = master->prog;
     this->idx           = master->idx;
     this->sstart        = master->seed;
     this->scnt          = 0;
     this->seed          = master->seed;
 
     this->env.stop      = &master->stop;
+    this->env48.stop    = &master->stop;
 }
 
 SearchWorker::~SearchWorker()
 {
 }
 
+void SearchWorker::setRange(uint64_t start, uint64_t end)
+{
+    // the range has to appear empty to thieves until it is complete
+    this->end = 0;
+    this->next = start;
+    this->end = end;
+}
+
+void SearchWorker::addResult(uint64_t seed)
+{
+    rbuf.push_back(seed);
+    rpos.push_back(ipos);
+    if (rbuf.size() >= SearchMaster::RESULT_BATCH)
+        flushResults(false);
+}
+
+void SearchWorker::addDone(uint64_t first, uint64_t last)
+{
+    // consecutive items of a worker are usually adjacent
+    if (!dbuf.empty() && dbuf.back() + 1 == first)
+        dbuf.back() = last;
+    else
+    {
+        dbuf.push_back(first);
+        dbuf.push_back(last);
+    }
+}
+
+void SearchWorker::flushResults(bool force)
+{
+    // The completed ranges go along with the results that precede them, or
+    // on their own at intervals, so they never overtake their results.
+    if (rbuf.empty())
+    {
+        if (dbuf.empty())
+            return;
+        if (!force && donetimer.elapsed() < SearchMaster::CHECKPOINT_INTERVAL_MS)
+            return;
+    }
+    donetimer.start();
+    // only the first batch in an empty queue needs to wake the master
+    if (master->pushResults(rbuf, rpos, dbuf))
+        emit resultsReady();
+}
+
 bool SearchWorker::getNextItem()
 {
-    QMutexLocker locker(&master->mutex);
+    // a kernel only asks for the next item once the previous one is complete
+    if (scnt > 0)
+        addDone(ipos, ilast);
+    flushResults(false);
+    // Bounded backpressure: a worker never waits for a single result to be
+    // received, but it holds off with new items while the receiver is
+    // far behind, so the queued results cannot grow without limit.
+    while (master->rpending > SearchMaster::RESULT_PENDING_MAX && !*env.stop)
+        QThread::msleep(1);
+    if (stattimer.elapsed() >= SearchMaster::STATS_INTERVAL_MS)
+    {
+        master->mergeStats(this);
+        stattimer.start();
+    }
     return master->requestItem(this);
 }
 
-void SearchWorker::run()
+// Search kernel for one search type, with or without a candidate list. The
+// seeds of each item are processed in blocks, where stop requests and the
+// progress are only checked and reported between the blocks. (The template
+// arguments are constant, so the unused seed sources are compiled out.)
+template <int STYPE, bool LIST>
+void SearchWorker::runKernel()
 {
+    const int pass = (STYPE == SEARCH_48ONLY ? PASS_FULL_48 : PASS_FULL_64);
+    // last seed of an incremental search without a list
+    const uint64_t last = (STYPE == SEARCH_48ONLY ? MASK48 : ~(uint64_t)0);
     Pos origin = {0,0};
-    env.init(master->mc, master->large, master->condtree);
 
-    switch (master->searchtype)
+    while (!*env.stop && getNextItem())
     {
-    case SEARCH_LIST:
-        while (!*env.stop && getNextItem())
+        uint64_t pos0 = prog;
+        uint64_t lowidx = idx;
+        uint64_t high = (sstart >> 48) & 0xffff;
+        uint64_t low = sstart & MASK48;
+        uint64_t cur = sstart;
+        int n = scnt;
+
+        if (STYPE == SEARCH_LIST || (STYPE == SEARCH_48ONLY && LIST))
         {   // seed = slist[..]
             uint64_t ie = idx+scnt < len ? idx+scnt : len;
-            for (uint64_t i = idx; i < ie; i++)
-            {
-                seed = slist[i];
-                env.setSeed(seed);
-                if (testTreeAt(origin, &env, PASS_FULL_64, nullptr) == COND_OK)
-                {
-                    if (!*env.stop)
-                        emit result(seed);
-                }
-            }
-            //if (ie == len) // done
-            //   break;
+            n = idx < ie ? (int) (ie - idx) : 0;
+        }
+        if (STYPE == SEARCH_BLOCKS)
+        {   // seed = ([..] << 48) | low
+            if (LIST && idx >= len)
+                continue;
+            if (LIST)
+                low = slist[idx];
+            env.setSeed(low);
+            if (testTreeAt(origin, &env, PASS_FULL_48, nullptr) == COND_FAILED)
+                continue;
         }
-        break;
 
-    case SEARCH_48ONLY:
-        while (!*env.stop && getNextItem())
+        bool done = false;
+        for (int b = 0; b < n && !done; b += KERNEL_BLOCK)
         {
-            if (slist)
+            int be = n - b > KERNEL_BLOCK ? b + KERNEL_BLOCK : n;
+            uint64_t blk[KERNEL_BLOCK];
+            int k = 0;
+            for (int i = b; i < be; i++)
             {
-                uint64_t ie = idx+scnt < len ? idx+scnt : len;
-                for (uint64_t i = idx; i < ie; i++)
+                if (STYPE == SEARCH_LIST || (STYPE == SEARCH_48ONLY && LIST))
+                    cur = slist[lowidx++];
+                else if (STYPE == SEARCH_INC && LIST)
+                    cur = (high << 48) | slist[lowidx];
+                else if (STYPE == SEARCH_BLOCKS)
+                    cur = (high << 48) | low;
+                blk[k++] = cur;
+
+                if (STYPE == SEARCH_INC && LIST)
                 {
-                    seed = slist[i];
-                    env.setSeed(seed);
-                    if (testTreeAt(origin, &env, PASS_FULL_48, nullptr) != COND_FAILED)
+                    if (++lowidx >= len)
                     {
-                        if (!*env.stop)
-                            emit result(seed);
+                        lowidx = 0;
+                        if (++high >= 0x10000)
+                            done = true;
                     }
                 }
-            }
-            else
-            {
-                seed = sstart;
-                for (int i = 0; i < scnt; i++)
+                else if (STYPE == SEARCH_BLOCKS)
                 {
-                    env.setSeed(seed);
-                    if (testTreeAt(origin, &env, PASS_FULL_48, nullptr) != COND_FAILED)
-                    {
-                        if (!*env.stop)
-                            emit result(seed);
-                    }
-
-                    if (seed >= MASK48)
-                    {   // done
-                        break;
-                    }
-                    seed++;
+                    if (++high >= 0x10000)
+                        done = true;
                 }
-            }
-        }
-        break;
-
-    case SEARCH_INC:
-        while (!*env.stop && getNextItem())
-        {
-            if (slist)
-            {   // seed = (high << 48) | slist[..]
-                uint64_t high = (sstart >> 48) & 0xffff;
-                uint64_t lowidx = idx;
-
-                for (int i = 0; i < scnt; i++)
+                else if (!LIST)
                 {
-                    seed = (high << 48) | slist[lowidx];
-
-                    env.setSeed(seed);
-                    if (testTreeAt(origin, &env, PASS_FULL_64, nullptr) == COND_OK)
-                    {
-                        if (!*env.stop)
-                            emit result(seed);
-                    }
-
-                    if (++lowidx >= len)
-                    {
-                        lowidx = 0;
-                        if (++high >= 0x10000)
-                        {   // done
-                            break;
-                        }
-                    }
+                    if (cur == last)
+                        done = true;
+                    else
+                        cur++;
                 }
+                if (done)
+                    break;
             }
-            else
-            {   // seed++
-                seed = sstart;
-                for (int i = 0; i < scnt; i++)
+
+            for (int j = 0; j < k; j += BATCH_LANES)
+            {
+                int nl = k - j < BATCH_LANES ? k - j : BATCH_LANES;
+                uint32_t mask = (1U << nl) - 1;
+                // the lower 48 bits are fixed in a block search
+                if (STYPE != SEARCH_BLOCKS && !batch.empty())
+                    mask = batch.test(blk + j, nl);
+                for (; mask; mask &= mask - 1)
                 {
-                    env.setSeed(seed);
-                    if (testTreeAt(origin, &env, PASS_FULL_64, nullptr) == COND_OK)
+                    uint64_t s = blk[j + __builtin_ctz(mask)];
+                    env.setSeed(s);
+                    int st = testTreeAt(origin, &env, pass, nullptr);
+                    if (pass == PASS_FULL_48 ? st != COND_FAILED : st == COND_OK)
                     {
                         if (!*env.stop)
-                            emit result(seed);
+                            addResult(s);
                     }
-
-                    if (seed == ~(uint64_t)0)
-                    {   // done
-                        break;
-                    }
-                    seed++;
                 }
             }
+            seed = cur;
+            if (*env.stop)
+                break;
+            if (be < n) // the end of the item is reported with the next one
+                prog = pos0 + be;
         }
-        break;
-
-    case SEARCH_BLOCKS:
-        while (!*env.stop && getNextItem())
-        {   // seed = ([..] << 48) | low
-            if (slist && idx >= len)
-            {
-                continue;
-            }
-
-            uint64_t high = (sstart >> 48) & 0xffff;
-            uint64_t low;
-            if (slist)
-                low = slist[idx];
-            else
-                low = sstart & MASK48;
-
-            env.setSeed(low);
-            if (testTreeAt(origin, &env, PASS_FULL_48, nullptr) == COND_FAILED)
-            {
-                continue;
-            }
-
-            for (int i = 0; i < scnt; i++)
-            {
-                seed = (high << 48) | low;
+    }
+}
 
-                env.setSeed(seed);
-                if (testTreeAt(origin, &env, PASS_FULL_64, nullptr) == COND_OK)
-                {
-                    if (!*env.stop)
-                        emit result(seed);
-                }
+void SearchWorker::run()
+{
+    ConditionTree condtree;
+    {   // the plan of the master is tuned concurrently
+        QMutexLocker locker(&master->statmutex);
+        condtree = master->condtree;
+    }
+    env.init(master->mc, master->large, condtree);
+    if (!master->scankey.isEmpty() && !master->same48)
+        env48.init(master->mc, master->large, master->condtree48);
+    batch.init(env.condtree, master->mc);
+    stattimer.start();
+    donetimer.start();
 
-                if (++high >= 0x10000)
-                    break; // done
-            }
-        }
+    switch (master->searchtype)
+    {
+    case SEARCH_LIST:
+        runKernel<SEARCH_LIST, true>();
+        break;
+    case SEARCH_48ONLY:
+        if (len)
+            runKernel<SEARCH_48ONLY, true>();
+        else
+            runKernel<SEARCH_48ONLY, false>();
+        break;
+    case SEARCH_INC:
+        if (len)
+            runKernel<SEARCH_INC, true>();
+        else
+            runKernel<SEARCH_INC, false>();
+        break;
+    case SEARCH_BLOCKS:
+        if (len)
+            runKernel<SEARCH_BLOCKS, true>();
+        else
+            runKernel<SEARCH_BLOCKS, false>();
         break;
     }
+
+    flushResults(true);
+    master->mergeStats(this);
 }
 
 
@@ -2,7 +2,10 @@
 #define SEARCHTHREAD_H
 
 #include "search.h"
+#include "candcache.h"
 #include "config.h"
+#include "seedbatch.h"
+#include "seedlist.h"
 
 #include <QThread>
 #include <QMutex>
@@ -10,8 +13,11 @@
 #include <QElapsedTimer>
 #include <QTimer>
 #include <QMessageBox>
+#include <QWaitCondition>
 
 #include <deque>
+#include <map>
+#include <queue>
 
 struct Session
 {
@@ -24,10 +30,34 @@ struct Session
     Gen48Config gen48;
     std::vector<Condition> cv;
     std::vector<uint64_t> slist;
+    SeedList slistfile; // mapped seed list of the search (replaces slist)
+    QString plan; // tuned evaluation order of the conditions (optional)
 };
 
 struct SearchWorker;
-
+struct StreamReader;
+
+/* The search space is mapped onto a linear range of progress positions,
+ * [prog, send), which is distributed among the workers without a global
+ * lock: Each worker owns a range of positions from which it claims items
+ * with atomic operations. When the range runs dry, the worker takes a fresh
+ * span from the shared cursor and once that is exhausted, it steals the
+ * upper half of the largest remaining range of another worker.
+ *
+ * A block search without a candidate list has a producer stage instead of
+ * the shared cursor: the workers scan chunks of 48-bit bases with the fast
+ * checks and queue the viable ones, which are then expanded through the
+ * upper 16-bits by whichever worker runs out of work.
+ *
+ * A streamed list search has a reader thread instead, which fills a bounded
+ * queue with chunks of the list. The positions are then the byte offsets in
+ * the list, and each chunk is one work item.
+ *
+ * A 48-bit candidate list that is too large to be materialized is merged on
+ * the fly (see TransposedList), and each item then reads its window of the
+ * list when it is claimed. A worker keeps its merge between items, so it
+ * only restarts the merge at a mark after a jump, such as a steal.
+ */
 struct SearchMaster : QObject
 {
     Q_OBJECT
@@ -38,9 +68,23 @@ public:
     bool set(QWidget *widget, const Session& s);
 
     void preSearch();
+    void applyShard();
+    void applyRange(uint64_t first, uint64_t last);
+
+    // Restrict the following searches to the progress positions
+    // [first, last], e.g. for a lease of a distributed search. (A streamed
+    // list cannot be restricted, its reader continues to the end.)
+    bool setLease(uint64_t first, uint64_t last);
+
+    // Pass over the progress positions that a resumed search has already
+    // completed, given as merged ranges (first -> last).
+    void setCompleted(const std::map<uint64_t, uint64_t>& ranges);
 
     void startSearch();
     void stopSearch();
+    // Stop handing out work items, but let the workers complete their
+    // current ones. The search finishes as usual when they are done.
+    void drainSearch();
 
     // Get search progress:
     //  status  : progress status summary
@@ -52,29 +96,130 @@ public:
     //  avg     : search speed average
     bool getProgress(QString *status, uint64_t *prog, uint64_t *end, uint64_t *seed, qreal *min, qreal *avg, qreal *max);
 
+    // Get the next work item for a worker. (Called from the worker threads.)
     bool requestItem(SearchWorker *item);
 
+    // Fill the queue of a streamed list. (Called from the reader thread.)
+    void readStream();
+
+    // Get the lowest progress position that is still pending.
+    uint64_t getPosition();
+
+    // Get the seed at a given progress position. (The list entry of the
+    // position can be given when it is already known.)
+    uint64_t seedAt(uint64_t pos, const uint64_t *entry = NULL) const;
+
+    // Merge the condition counters of a worker and hand it the tuned plan.
+    void mergeStats(SearchWorker *item);
+
+    // Get the current plan of the condition tree in its text form.
+    QString getPlan();
+
+    // Get the condition counters merged from the workers (one list per pass).
+    void getStats(std::vector<CondStats> *stats);
+
+    // Get the condition profile as a text table with a fixed number of lines:
+    // a header and one line per condition.
+    QStringList getProfile();
+
+private:
+    bool claimSpan(SearchWorker *item);
+    bool claimBase(SearchWorker *item);
+    bool scanBases(SearchWorker *item, uint64_t low, uint64_t lend);
+    void queueBase(uint64_t pos);
+    bool stealSpan(SearchWorker *item);
+    bool skipCompleted(uint64_t *pos, uint64_t *lim) const;
+    bool isCompleted(uint64_t first, uint64_t last) const;
+    bool claimChunk(SearchWorker *item);
+    void readWindow(SearchWorker *item);
+    void joinReader();
+    uint64_t lowestPending();
+    uint64_t scanPending();
+    void beginTransfer();
+    // Wait for the pending transfers and hold off new ones. (With 'mutex'
+    // held, until 'frozen' is cleared.)
+    void holdTransfers();
+
+    // Hand over a batch of results and of completed ranges from a worker
+    // (the vectors are consumed).
+    // Returns true when the result queue was empty before.
+    bool pushResults(std::vector<uint64_t>& seeds, std::vector<uint64_t>& pos, std::vector<uint64_t>& done);
+
+    // Deliver the queued results to the receiver. (Called in the master's thread.)
+    void flushResults();
+
+    // Keep a run of scanned bases for the candidate cache, and extend the
+    // cached set with the runs when the workers are done.
+    void recordScan(CandidateSet& run);
+    void saveScanCache();
+
+private:
+    QVector<uint64_t> takeResults(QVector<uint64_t> *done, QVector<uint64_t> *pos = nullptr);
+
 public slots:
-    void onWorkerResult(uint64_t seed);
+    void onWorkerResults();
     void onWorkerFinished();
 
 signals:
-    void searchResult(uint64_t seed);
+    // Results, with the first progress position of the item that found each
+    // of them (the results belong to that item's completed range).
+    void searchResults(QVector<uint64_t> seeds, QVector<uint64_t> pos);
+    // Completed ranges of progress positions, as pairs of first and last.
+    // A range is only reported after all of its results.
+    void searchCheckpoint(QVector<uint64_t> done);
     void searchFinish(bool done);
+    // Progress of the candidate preparation in preSearch(), which runs on the
+    // calling thread (a receiver may stop the search).
+    void searchPrepare(double progress);
 
 public:
     struct TProg { uint64_t ns, prog; };
 
+    // results are queued as batches in a lock-free stack
+    struct ResultBatch
+    {
+        ResultBatch *next;
+        std::vector<uint64_t> seeds;
+        std::vector<uint64_t> pos;      // item position of each result
+        std::vector<uint64_t> done;     // completed ranges (first, last)
+    };
+
+    // a chunk of a streamed list, with its range of byte offsets
+    struct StreamChunk
+    {
+        uint64_t begin, end;
+        std::vector<uint64_t> seeds;
+    };
+
+    // attempts to read the pending position before transfers are held off
+    enum { PENDING_RETRIES = 64 };
+    // items per span that a worker takes from the shared cursor
+    enum { SPAN_ITEMS = 16 };
+    // 48-bit bases per chunk of the block search producer stage
+    enum { SCAN_CHUNK = 256 };
+    // viable bases of a scan that are kept for the candidate cache at most
+    enum { SCAN_CACHE_MAX = 1 << 26 };
+    // results a worker collects before it hands them over
+    enum { RESULT_BATCH = 4096 };
+    // queued results at which workers hold off with new items
+    enum { RESULT_PENDING_MAX = 1 << 20 };
+    // interval at which workers merge their condition counters
+    enum { STATS_INTERVAL_MS = 1000 };
+    // interval at which workers report completed ranges without results
+    enum { CHECKPOINT_INTERVAL_MS = 1000 };
+    // seeds per chunk of a streamed list, and chunks that are read ahead
+    enum { STREAM_CHUNK = 16384 };
+    enum { STREAM_QUEUE = 16 };
+
 public:
     std::vector<SearchWorker*>  workers;
 
     QMutex                      mutex;
     std::atomic_bool            stop;
+    std::atomic_bool            drain;      // no new items are handed out
 
     std::deque<TProg>           proghist;
     QElapsedTimer               progtimer;
-    QElapsedTimer               itemtimer;
-    uint64_t                    count;
 
     SearchThreadEnv             env;
 
@@ -82,17 +227,74 @@ public:
     int                         mc;
     int                         large;
     ConditionTree               condtree;
-    int                         itemsize;   // number of seeds per search item
+    int                         itemsize;   // initial number of seeds per search item
     int                         threadcnt;  // numbr of worker threads
     Gen48Config                 gen48;      // 48-bit generator settings
-    std::vector<uint64_t>       slist;      // candidate list
+    SeedList                    slist;      // candidate list
+    uint64_t                    sortmem;    // memory budget for sorting candidates (bytes)
     uint64_t                    idx;        // index within candidate list
     uint64_t                    scnt;       // search space size
-    uint64_t                    prog;       // search space progress tracker
+    uint64_t                    prog;       // search space progress at start
     uint64_t                    seed;       // current seed (next to be processed)
     uint64_t                    smin;
     uint64_t                    smax;
-    bool                        isdone;
+    int                         shard;      // searched part of the search space
+    int                         shards;     // (number of parts)
+    bool                        leased;     // search the range [lfirst, llast]
+    uint64_t                    lfirst;
+    uint64_t                    llast;
+    bool                        prepared;   // the candidate list is ready
+    std::atomic_bool            isdone;
+
+    /// work distribution
+    uint64_t                    sbegin;     // start of progress positions
+    uint64_t                    send;       // end of progress positions (exclusive)
+    bool                        sfull;      // search space includes position 'send'
+    uint64_t                    lowmin;     // list index of the first low 48-bits
+    std::atomic_uint64_t        cursor;     // start of the unassigned search space
+    std::atomic_uint64_t        version;    // incremented after each transfer
+    std::atomic_int             transfers;  // number of ranges changing owner
+    std::atomic_bool            frozen;     // new transfers wait for 'mutex'
+    std::map<uint64_t, uint64_t> completed; // ranges done before a resume
+
+    /// viable 48-bit bases of a block search (as progress positions)
+    QMutex                      qmutex;
+    std::priority_queue<uint64_t, std::vector<uint64_t>, std::greater<uint64_t>> bases;
+    std::atomic_uint64_t        queuemin;   // lowest queued position
+
+    /// persistent cache of the candidates (see candcache.h)
+    QString                     cachedir;   // (no caching if empty)
+    // The top-level branches of the condition tree that have 48-bit checks:
+    // a base that fails them fails the whole tree, so their viable bases can
+    // be shared by block searches that only differ in other conditions.
+    ConditionTree               condtree48;
+    bool                        has48;
+    bool                        same48;     // condtree48 is the whole tree
+    QString                     scankey;    // cache key of the scan (empty if off)
+    CandidateSet                scancache;  // cached viable bases
+    QMutex                      cmutex;
+    std::map<uint64_t, CandidateSet> scanned; // runs scanned by this search
+    uint64_t                    scannedcnt; // bases in 'scanned'
+    bool                        scanfull;   // too many to be cached
+
+    /// streamed list (a list search with SearchConfig::liststream)
+    bool                        streaming;
+    QString                     streampath;
+    SeedStream                  stream;
+    StreamReader              * reader;
+    QMutex                      smutex;
+    QWaitCondition              snotfull;
+    QWaitCondition              snotempty;
+    std::deque<StreamChunk>     chunks;
+    bool                        seof;       // the whole list has been read
+
+    /// result delivery
+    std::atomic<ResultBatch*>   rhead;      // most recent batch
+    std::atomic_int64_t         rpending;   // number of queued results
+
+    /// adaptive condition order (the plan of condtree is tuned during the search)
+    QMutex                      statmutex;
+    std::vector<CondStats>      stats[PASS_FULL_64+1]; // merged counters
 };
 
 
@@ -103,20 +305,42 @@ public:
     SearchWorker(SearchMaster *master);
     ~SearchWorker();
 
+    void setRange(uint64_t start, uint64_t end);
     bool getNextItem();
     virtual void run() override;
 
+    template <int STYPE, bool LIST>
+    void runKernel();
+
+    void addResult(uint64_t seed);
+    void addDone(uint64_t first, uint64_t last);
+    void flushResults(bool force);
+
 signals:
-    void result(uint64_t seed);
+    void resultsReady();
 
 public:
+    // seeds that a kernel processes between progress updates
+    enum { KERNEL_BLOCK = 256 };
+
     SearchMaster      * master;
 
     const uint64_t    * slist;      // candidate list
     uint64_t            len;        // number of candidates
 
+    /// owned range of progress positions (see SearchMaster)
+    std::atomic_uint64_t next;      // start of the next unclaimed item
+    std::atomic_uint64_t end;       // end of the owned range (exclusive)
+    QMutex              stealmutex; // taken by thieves and on claim conflicts
+    int                 itemsize;   // adaptive number of seeds per item
+    QElapsedTimer       itemtimer;
+    QElapsedTimer       stattimer;  // time since the counters were merged
+    QElapsedTimer       donetimer;  // time since the completed ranges were reported
+
     /// current work item
-    uint64_t            prog;       // search space progress
+    std::atomic_uint64_t prog;      // search space progress (lowest pending position)
+    uint64_t            ipos;       // first position of the item
+    uint64_t            ilast;      // last position of the item
     uint64_t            idx;        // current index in candidate buffer
     uint64_t            sstart;     // starting seed
     int                 scnt;       // number of seeds to process in this item
@@ -124,8 +348,23 @@ public:
     // the end seed is the highest unsigned seed value in the search space
     // (or the last entry in the seed list)
 
-private:
+    std::vector<uint64_t> rbuf;     // results that have not been handed over
+    std::vector<uint64_t> rpos;     // (with the position of their item)
+    std::vector<uint64_t> dbuf;     // completed ranges (first, last) not handed over
+    std::vector<uint64_t> chunk;    // seeds of a streamed item (or of a merged list)
+    SeedCursor          merge;      // merge state of a transposed list between items
+
     SearchThreadEnv     env;
+    SearchThreadEnv     env48;      // for SearchMaster::condtree48
+    BatchFilter         batch;      // pre-filter over batches of seeds
+};
+
+struct StreamReader : QThread
+{
+    StreamReader(SearchMaster *master) : QThread(nullptr), master(master) {}
+    virtual void run() override { master->readStream(); }
+
+    SearchMaster      * master;
 };
 
 
@@ -0,0 +1,316 @@
+#include "seedbatch.h"
+
+#include "cpudispatch.h"
+
+#include "cubiomes/finders.h"
+
+#define LCG_K   0x5deece66dULL
+#define LCG_B   0xbULL
+#define LCG_M   ((1ULL << 48) - 1)
+
+
+static inline bool inArea(const BatchCheck& c, int x, int z)
+{
+    bool inside;
+    if (c.rmaxsq)
+        inside = (x*(int64_t)x + z*(int64_t)z < c.rmaxsq);
+    else
+        inside = (x >= c.x1 && x <= c.x2 && z >= c.z1 && z <= c.z2);
+    if (c.skipref && x == 0 && z == 0)
+        inside = false;
+    return inside;
+}
+
+// Counts the instances of a check for each lane. Lanes where the Java
+// nextInt() would draw again are flagged as unsure.
+static ISA_INLINE
+void countLanes(const BatchCheck& c, const uint64_t *seeds, int *cnt, int *unsure)
+{
+    for (int l = 0; l < BATCH_LANES; l++)
+        cnt[l] = unsure[l] = 0;
+
+    const int n = c.offs.size();
+    if (c.kind == BatchCheck::SLIME)
+    {
+        for (int i = 0; i < n; i++)
+        {
+            uint64_t off = c.offs[i];
+            for (int l = 0; l < BATCH_LANES; l++)
+            {
+                uint64_t s = (seeds[l] + off) ^ 0x3ad8025fULL ^ LCG_K;
+                s = (s * LCG_K + LCG_B) & LCG_M;
+                uint32_t bits = (uint32_t)(s >> 17);
+                uint32_t val = bits % 10;
+                cnt[l] += (val == 0);
+                unsure[l] |= (bits - val + 9 > 0x7fffffffU);
+            }
+        }
+        return;
+    }
+
+    const int r = c.range;
+    for (int i = 0; i < n; i++)
+    {
+        uint64_t off = c.offs[i];
+        int bx = c.pos[i].x * c.regsize;
+        int bz = c.pos[i].z * c.regsize;
+        for (int l = 0; l < BATCH_LANES; l++)
+        {
+            uint64_t s = (seeds[l] + off) ^ LCG_K;
+            s = (s * LCG_K + LCG_B) & LCG_M;
+            int vx = (int)(s >> 17);
+            s = (s * LCG_K + LCG_B) & LCG_M;
+            int vz = (int)(s >> 17);
+            int cx, cz;
+            if ((r & (r-1)) == 0)
+            {
+                cx = (int)((r * (uint64_t)vx) >> 31);
+                cz = (int)((r * (uint64_t)vz) >> 31);
+            }
+            else
+            {   // remainder through a reciprocal, which vectorizes
+                cx = vx - r * (int)(vx * c.rinv);
+                cz = vz - r * (int)(vz * c.rinv);
+                cx += (cx < 0 ? r : 0) - (cx >= r ? r : 0);
+                cz += (cz < 0 ? r : 0) - (cz >= r ? r : 0);
+                // nextInt() draws again when the bucket of the value overflows
+                unsure[l] |= ((uint32_t) vx - cx + (r - 1) > 0x7fffffffU);
+                unsure[l] |= ((uint32_t) vz - cz + (r - 1) > 0x7fffffffU);
+            }
+            int x = (bx + cx) << 4;
+            int z = (bz + cz) << 4;
+            cnt[l] += inArea(c, x, z);
+        }
+    }
+}
+
+static ISA_INLINE
+uint32_t testLanes(const std::vector<BatchCheck>& checks, const uint64_t *seeds)
+{
+    uint32_t mask = (1U << BATCH_LANES) - 1;
+    int cnt[BATCH_LANES], unsure[BATCH_LANES];
+    for (const BatchCheck& c : checks)
+    {
+        countLanes(c, seeds, cnt, unsure);
+        for (int l = 0; l < BATCH_LANES; l++)
+        {
+            if (unsure[l])
+                continue;
+            if (c.count == 0 ? cnt[l] > 0 : cnt[l] < c.count)
+                mask &= ~(1U << l);
+        }
+        if (!mask)
+            break;
+    }
+    return mask;
+}
+
+// The same loop is compiled for each instruction set and chosen at runtime.
+static uint32_t testDefault(const std::vector<BatchCheck>& checks, const uint64_t *seeds)
+{
+    return testLanes(checks, seeds);
+}
+
+#if CPU_DISPATCH_X86
+ISA_TARGET_SSE42
+static uint32_t testSse42(const std::vector<BatchCheck>& checks, const uint64_t *seeds)
+{
+    return testLanes(checks, seeds);
+}
+
+ISA_TARGET_AVX2
+static uint32_t testAvx2(const std::vector<BatchCheck>& checks, const uint64_t *seeds)
+{
+    return testLanes(checks, seeds);
+}
+
+ISA_TARGET_AVX512
+static uint32_t testAvx512(const std::vector<BatchCheck>& checks, const uint64_t *seeds)
+{
+    return testLanes(checks, seeds);
+}
+#endif
+
+static batch_fn getBatchFn()
+{
+    switch (getCpuIsa())
+    {
+#if CPU_DISPATCH_X86
+    case ISA_AVX512:    return testAvx512;
+    case ISA_AVX2:      return testAvx2;
+    case ISA_SSE42:     return testSse42;
+#endif
+    default:            return testDefault;
+    }
+}
+
+
+static bool isFeatureStruct(int stype)
+{   // structures that use the plain feature position of a region
+    switch (stype)
+    {
+    case Desert_Pyramid:
+    case Jungle_Temple:
+    case Swamp_Hut:
+    case Igloo:
+    case Village:
+    case Ocean_Ruin:
+    case Shipwreck:
+    case Ruined_Portal:
+    case Ruined_Portal_N:
+    case Ancient_City:
+    case Trail_Ruins:
+    case Trial_Chambers:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// compare a check with the scalar implementation for some random seeds
+static bool verifyCheck(const BatchCheck& c, int mc)
+{
+    uint64_t rng = 0x2545f4914f6cdd1dULL;
+    for (int t = 0; t < 16; t++)
+    {
+        uint64_t seeds[BATCH_LANES];
+        for (int l = 0; l < BATCH_LANES; l++)
+        {
+            rng = rng * 6364136223846793005ULL + 1442695040888963407ULL;
+            seeds[l] = rng ^ (rng >> 29);
+        }
+        int cnt[BATCH_LANES], unsure[BATCH_LANES];
+        countLanes(c, seeds, cnt, unsure);
+        for (int l = 0; l < BATCH_LANES; l++)
+        {
+            if (unsure[l])
+                continue;
+            int n = 0;
+            for (const Pos& p : c.pos)
+            {
+                if (c.kind == BatchCheck::SLIME)
+                {
+                    n += isSlimeChunk(seeds[l], p.x, p.z) != 0;
+                }
+                else
+                {
+                    Pos pc;
+                    if (getStructurePos(c.stype, mc, seeds[l], p.x, p.z, &pc))
+                        n += inArea(c, pc.x, pc.z);
+                }
+            }
+            if (n != cnt[l])
+                return false;
+        }
+    }
+    return true;
+}
+
+int BatchFilter::init(const ConditionTree& tree, int mc)
+{
+    // area limit of a check, larger areas are left to the tree
+    enum { MAX_POSITIONS = 1024 };
+
+    checks.clear();
+    fn = getBatchFn();
+    if (tree.prog.empty() || tree.prog[0].kind != CondOp::OP_CENTER)
+        return 0;
+
+    // the conditions at the root are combined via AND, so any of them
+    // failing in the fast pass rejects the seed
+    for (char b : tree.references[0])
+    {
+        const Condition& c = tree.condvec[b];
+        const CondOp& op = tree.prog[b];
+        BatchCheck bc;
+        bc.count = c.count;
+        bc.skipref = c.skipref;
+        if (op.rad >= 0)
+        {
+            bc.x1 = bc.z1 = -op.rad;
+            bc.x2 = bc.z2 = +op.rad;
+            bc.rmaxsq = op.rmaxsq;
+        }
+        else
+        {
+            bc.x1 = c.x1;
+            bc.z1 = c.z1;
+            bc.x2 = c.x2;
+            bc.z2 = c.z2;
+            bc.rmaxsq = 0;
+        }
+        bc.stype = op.finfo->stype;
+        bc.regsize = bc.range = 1;
+        bc.rinv = 1;
+
+        if (c.type == F_SLIME)
+        {
+            if (c.count < 0 || c.count > 128)
+                continue;
+            bc.kind = BatchCheck::SLIME;
+            // slime chunks are tested in the bounding rectangle
+            int rx1 = bc.x1 >> 4, rz1 = bc.z1 >> 4;
+            int rx2 = bc.x2 >> 4, rz2 = bc.z2 >> 4;
+            if ((int64_t)(rx2-rx1+1) * (rz2-rz1+1) > MAX_POSITIONS)
+                continue;
+            for (int rz = rz1; rz <= rz2; rz++)
+            {
+                for (int rx = rx1; rx <= rx2; rx++)
+                {
+                    if (c.skipref && rx == 0 && rz == 0)
+                        continue;
+                    bc.pos.push_back(Pos{rx, rz});
+                    bc.offs.push_back(slimeOffset(rx, rz));
+                }
+            }
+            bc.rmaxsq = 0;
+            bc.skipref = false;
+        }
+        else if (bc.stype > 0 && op.sconfok && isFeatureStruct(bc.stype))
+        {
+            if (c.count <= 0 || c.count > 128)
+                continue;
+            const StructureConfig& sconf = op.sconf;
+            bc.kind = BatchCheck::STRUCT;
+            bc.regsize = sconf.regionSize;
+            bc.range = sconf.chunkRange;
+            if (bc.range <= 0)
+                continue;
+            bc.rinv = 1.0 / bc.range;
+            int rx1, rz1, rx2, rz2;
+            rx1 = floordiv(bc.x1, sconf.regionSize << 4);
+            rz1 = floordiv(bc.z1, sconf.regionSize << 4);
+            rx2 = floordiv(bc.x2, sconf.regionSize << 4);
+            rz2 = floordiv(bc.z2, sconf.regionSize << 4);
+            if ((int64_t)(rx2-rx1+1) * (rz2-rz1+1) > MAX_POSITIONS)
+                continue;
+            for (int rz = rz1; rz <= rz2; rz++)
+            {
+                for (int rx = rx1; rx <= rx2; rx++)
+                {
+                    bc.pos.push_back(Pos{rx, rz});
+                    bc.offs.push_back(rx*341873128712ULL + rz*132897987541ULL + sconf.salt);
+                }
+            }
+        }
+        else
+        {
+            continue;
+        }
+
+        if (verifyCheck(bc, mc))
+            checks.push_back(bc);
+    }
+    return checks.size();
+}
+
+uint32_t BatchFilter::test(const uint64_t *seeds, int n) const
+{
+    uint32_t valid = (n >= BATCH_LANES) ? (1U << BATCH_LANES) - 1 : (1U << n) - 1;
+    if (n >= BATCH_LANES)
+        return fn(checks, seeds) & valid;
+    uint64_t buf[BATCH_LANES];
+    for (int l = 0; l < BATCH_LANES; l++)
+        buf[l] = seeds[l < n ? l : 0];
+    return fn(checks, buf) & valid;
+}
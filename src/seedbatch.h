@@ -0,0 +1,57 @@
+#ifndef SEEDBATCH_H
+#define SEEDBATCH_H
+
+#include "search.h"
+
+#include <vector>
+
+/* Batched pre-filter for the incremental search kernels.
+ *
+ * Slime chunk and structure position conditions that are combined via AND
+ * at the root of the tree are necessary for every seed. Their counts only
+ * depend on short runs of the Java LCG, so they are evaluated for a batch
+ * of consecutive seeds at once, in a loop that is dispatched at runtime to
+ * the best instruction set of the CPU (see cpudispatch.h). Only the seeds
+ * that survive are passed on to the scalar testTreeAt().
+ */
+
+enum { BATCH_LANES = 8 };
+
+struct BatchCheck
+{
+    enum { SLIME, STRUCT };
+    int kind;
+    int count;              // required instances (0 for an exclusion)
+    int x1, z1, x2, z2;     // block area around the origin
+    int64_t rmaxsq;         // squared radius for circular areas
+    bool skipref;
+    // chunk (slime) or region (structure) positions and their seed offsets
+    std::vector<Pos> pos;
+    std::vector<uint64_t> offs;
+    // structure config
+    int stype;
+    int regsize;            // region size in chunks
+    int range;              // chunk range within a region
+    double rinv;
+};
+
+typedef uint32_t (*batch_fn)(const std::vector<BatchCheck>& checks, const uint64_t *seeds);
+
+struct BatchFilter
+{
+    std::vector<BatchCheck> checks;
+    batch_fn fn;
+
+    BatchFilter() : checks(), fn() {}
+
+    // Collect the checks of the tree, each of which is verified against the
+    // scalar implementation. Returns the number of usable checks.
+    int init(const ConditionTree& tree, int mc);
+    bool empty() const { return checks.empty(); }
+
+    // Test 'n' (<= BATCH_LANES) seeds, returning a mask of the seeds that
+    // may satisfy the tree.
+    uint32_t test(const uint64_t *seeds, int n) const;
+};
+
+#endif // SEEDBATCH_H
@@ -0,0 +1,951 @@
+#include "seedlist.h"
+
+#include "cubiomes/rng.h"
+#include "cubiomes/util.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QTemporaryFile>
+#include <QtEndian>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <thread>
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+static const char g_magic[8] = "CVSEEDS";
+
+
+static bool readHeader(const uchar *head, uint32_t *flags, uint64_t *cnt)
+{
+    if (memcmp(head, g_magic, sizeof(g_magic)) != 0)
+        return false;
+    if (qFromLittleEndian<quint32>(head + 8) != SEEDLIST_VERSION)
+        return false;
+    *flags = qFromLittleEndian<quint32>(head + 12);
+    *cnt = qFromLittleEndian<quint64>(head + 16);
+    return true;
+}
+
+static void writeHeader(uchar *head, uint32_t flags, uint64_t cnt)
+{
+    memcpy(head, g_magic, sizeof(g_magic));
+    qToLittleEndian<quint32>(SEEDLIST_VERSION, head + 8);
+    qToLittleEndian<quint32>(flags, head + 12);
+    qToLittleEndian<quint64>(cnt, head + 16);
+}
+
+
+SeedList::SeedList()
+    : vec()
+    , file()
+    , merged()
+    , ptr()
+    , len()
+    , sorted()
+{
+}
+
+bool SeedList::map(QString path)
+{
+    std::shared_ptr<QFile> f(new QFile(path));
+    if (!f->open(QIODevice::ReadOnly))
+    {
+        clear();
+        return false;
+    }
+    return map(f);
+}
+
+bool SeedList::map(std::shared_ptr<QFile> f)
+{
+    clear();
+    uchar head[SEEDLIST_HEADER];
+    uint32_t flags;
+    uint64_t cnt;
+    if (!f->seek(0) || f->read((char*) head, sizeof(head)) != sizeof(head) || !readHeader(head, &flags, &cnt))
+        return false;
+    if ((uint64_t)(f->size() - SEEDLIST_HEADER) / sizeof(uint64_t) < cnt)
+        return false; // truncated
+    if (cnt == 0)
+        return true;
+
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+    // the header keeps the seeds 8-byte aligned in the page aligned mapping
+    uchar *m = f->map(0, SEEDLIST_HEADER + cnt * sizeof(uint64_t));
+    if (!m)
+        return false;
+    file = f;
+    ptr = (const uint64_t*) (m + SEEDLIST_HEADER);
+    len = cnt;
+#else
+    try {
+        vec.resize(cnt);
+    } catch (...) {
+        return false;
+    }
+    qint64 n = cnt * sizeof(uint64_t);
+    if (f->read((char*) vec.data(), n) != n)
+    {
+        vec.clear();
+        return false;
+    }
+    for (uint64_t& s : vec)
+        s = qFromLittleEndian<quint64>(s);
+#endif
+    sorted = (flags & SEEDLIST_SORTED) != 0;
+    return true;
+}
+
+void SeedList::assign(const std::vector<uint64_t>& seeds)
+{
+    clear();
+    vec = seeds;
+}
+
+void SeedList::take(std::vector<uint64_t>& seeds, bool sorted)
+{
+    clear();
+    vec.swap(seeds);
+    seeds.clear();
+    this->sorted = sorted;
+}
+
+void SeedList::clear()
+{
+    vec.clear();
+    file.reset();
+    merged.reset();
+    ptr = nullptr;
+    len = 0;
+    sorted = false;
+}
+
+std::vector<uint64_t>& SeedList::edit()
+{
+    if (file)
+    {
+        vec.assign(ptr, ptr + len);
+        file.reset();
+        ptr = nullptr;
+        len = 0;
+    }
+    else if (merged)
+    {
+        merged->read(0, len, vec);
+        merged.reset();
+        len = 0;
+    }
+    sorted = false;
+    return vec;
+}
+
+bool SeedList::transpose(const std::vector<uint64_t>& offsets,
+        const std::function<bool(double)>& progress)
+{
+    if (merged || !sorted || (!empty() && back() > MASK48))
+    {   // the merge needs a sorted 48-bit base list
+        std::vector<uint64_t>& v = edit();
+        for (uint64_t& s : v)
+            s &= MASK48;
+        std::sort(v.begin(), v.end());
+        v.erase(std::unique(v.begin(), v.end()), v.end());
+    }
+    std::shared_ptr<TransposedList> t(new TransposedList(std::move(*this), offsets));
+    clear();
+    if (!t->index(progress))
+        return false;
+    merged = t;
+    len = t->size();
+    sorted = true;
+    return len > 0;
+}
+
+uint64_t SeedList::lowerBound(uint64_t v) const
+{
+    if (merged)
+        return merged->lowerBound(v);
+    return std::lower_bound(begin(), end(), v) - begin();
+}
+
+uint64_t SeedList::upperBound(uint64_t v) const
+{
+    if (merged)
+        return v >= MASK48 ? len : merged->lowerBound(v + 1);
+    return std::upper_bound(begin(), end(), v) - begin();
+}
+
+void SeedList::read(uint64_t idx, uint64_t n, std::vector<uint64_t>& out) const
+{
+    if (merged)
+    {
+        merged->read(idx, n, out);
+        return;
+    }
+    out.clear();
+    if (idx >= size())
+        return;
+    if (n > size() - idx)
+        n = size() - idx;
+    out.assign(data() + idx, data() + idx + n);
+}
+
+uint64_t SeedList::at(uint64_t i) const
+{
+    return merged->at(i);
+}
+
+
+// Merges the streams of a transposed list, skipping duplicate seeds.
+struct TransposeMerger
+{
+    typedef std::pair<uint64_t, size_t> Entry; // (seed, stream)
+
+    const TransposedList& t;
+    const uint64_t *b;
+    uint64_t n;
+    std::vector<uint64_t> step;     // current step within each stream
+    std::vector<Entry> heap;        // min-heap of the stream heads
+    uint64_t last;
+    bool started;
+
+    TransposeMerger(const TransposedList& t)
+        : t(t)
+        , b(t.base.data())
+        , n(t.base.size())
+        , step(t.offs.size())
+        , heap()
+        , last()
+        , started()
+    {
+    }
+
+    uint64_t value(size_t j, uint64_t k) const
+    {
+        uint64_t i = t.rot[j] + k;
+        if (i >= n)
+            i -= n;
+        return (b[i] + t.offs[j]) & MASK48;
+    }
+
+    // position each stream at its first seed that is not less than 'v'
+    void start(uint64_t v)
+    {
+        heap.clear();
+        started = false;
+        for (size_t j = 0; j < step.size(); j++)
+        {
+            uint64_t lo = 0, hi = n;
+            while (lo < hi)
+            {
+                uint64_t mid = lo + (hi - lo) / 2;
+                if (value(j, mid) < v)
+                    lo = mid + 1;
+                else
+                    hi = mid;
+            }
+            step[j] = lo;
+            if (lo < n)
+                heap.push_back(Entry(value(j, lo), j));
+        }
+        std::make_heap(heap.begin(), heap.end(), std::greater<Entry>());
+    }
+
+    bool next(uint64_t *s)
+    {
+        while (!heap.empty())
+        {
+            std::pop_heap(heap.begin(), heap.end(), std::greater<Entry>());
+            Entry e = heap.back();
+            heap.pop_back();
+            size_t j = e.second;
+            if (++step[j] < n)
+            {
+                heap.push_back(Entry(value(j, step[j]), j));
+                std::push_heap(heap.begin(), heap.end(), std::greater<Entry>());
+            }
+            if (started && e.first == last)
+                continue;
+            started = true;
+            last = e.first;
+            *s = last;
+            return true;
+        }
+        return false;
+    }
+};
+
+TransposedList::TransposedList(SeedList&& list, const std::vector<uint64_t>& offsets)
+    : base(std::move(list))
+    , offs(offsets)
+    , rot()
+    , marks()
+    , len()
+{
+    for (uint64_t& d : offs)
+        d &= MASK48;
+    std::sort(offs.begin(), offs.end());
+    offs.erase(std::unique(offs.begin(), offs.end()), offs.end());
+
+    // a stream begins with the seeds that wrap around
+    for (uint64_t d : offs)
+        rot.push_back(base.lowerBound(MASK48 + 1 - d));
+}
+
+bool TransposedList::index(const std::function<bool(double)>& progress)
+{
+    TransposeMerger m(*this);
+    m.start(0);
+    marks.clear();
+    len = 0;
+    uint64_t s;
+    while (m.next(&s))
+    {
+        if (len % MARK_STEP == 0)
+        {
+            marks.push_back(s);
+            if (progress && (len & 0xfffff) == 0 && !progress((double) s / (MASK48 + 1)))
+                return false;
+        }
+        len++;
+    }
+    return true;
+}
+
+uint64_t TransposedList::at(uint64_t idx) const
+{
+    TransposeMerger m(*this);
+    m.start(marks[idx / MARK_STEP]);
+    uint64_t s = 0;
+    for (uint64_t i = idx % MARK_STEP; m.next(&s) && i > 0; i--);
+    return s;
+}
+
+uint64_t TransposedList::lowerBound(uint64_t v) const
+{
+    size_t k = std::upper_bound(marks.begin(), marks.end(), v) - marks.begin();
+    if (k == 0)
+        return 0;
+    k--;
+    TransposeMerger m(*this);
+    m.start(marks[k]);
+    uint64_t idx = k * MARK_STEP;
+    uint64_t s;
+    while (m.next(&s) && s < v)
+        idx++;
+    return idx;
+}
+
+void TransposedList::read(uint64_t idx, uint64_t n, std::vector<uint64_t>& out) const
+{
+    out.clear();
+    if (idx >= len)
+        return;
+    if (n > len - idx)
+        n = len - idx;
+    out.reserve(n);
+    TransposeMerger m(*this);
+    m.start(marks[idx / MARK_STEP]);
+    uint64_t s;
+    for (uint64_t i = idx % MARK_STEP; i > 0 && m.next(&s); i--);
+    while (out.size() < n && m.next(&s))
+        out.push_back(s);
+}
+
+
+SeedCursor::SeedCursor()
+    : src()
+    , merger()
+    , pos()
+{
+}
+
+SeedCursor::~SeedCursor()
+{
+}
+
+void SeedCursor::seek(uint64_t idx)
+{
+    uint64_t k = idx / TransposedList::MARK_STEP;
+    merger->start(src->marks[k]);
+    pos = k * TransposedList::MARK_STEP;
+}
+
+void SeedCursor::read(const SeedList& list, uint64_t idx, uint64_t n,
+    std::vector<uint64_t>& out)
+{
+    if (!list.merged)
+    {
+        list.read(idx, n, out);
+        return;
+    }
+    const TransposedList& t = *list.merged;
+    out.clear();
+    if (idx >= t.len)
+        return;
+    if (n > t.len - idx)
+        n = t.len - idx;
+    out.reserve(n);
+    size_t want = n;
+
+    if (src != list.merged || !merger)
+    {
+        src = list.merged;
+        merger.reset(new TransposeMerger(t));
+        seek(idx);
+    }
+    else if (n > 0 && merger->started && idx == pos - 1)
+    {   // the window begins with the seed that was read last
+        out.push_back(merger->last);
+        idx++;
+    }
+    if (idx < pos || idx - pos >= TransposedList::MARK_STEP)
+        seek(idx);
+
+    uint64_t s;
+    for (; pos < idx && merger->next(&s); pos++);
+    while (out.size() < want && merger->next(&s))
+    {
+        out.push_back(s);
+        pos++;
+    }
+}
+
+
+SeedStream::SeedStream()
+    : fp()
+    , binary()
+    , skipline()
+    , start()
+    , len()
+    , pos()
+    , buf()
+    , bpos()
+    , bend()
+{
+}
+
+SeedStream::~SeedStream()
+{
+    close();
+}
+
+bool SeedStream::open(QString path)
+{
+    close();
+    len = ~(uint64_t)0;
+    if (path == "-")
+    {
+        fp = stdin;
+#if defined(_WIN32)
+        _setmode(_fileno(stdin), _O_BINARY);
+#endif
+    }
+    else
+    {
+        QByteArray ba = path.toLocal8Bit();
+        fp = fopen(ba.data(), "rb");
+        len = QFileInfo(path).size();
+    }
+    if (!fp)
+        return false;
+
+    buf.resize(BUFSIZE);
+    bpos = bend = 0;
+    start = pos = 0;
+    binary = skipline = false;
+    fill();
+    if (bend >= sizeof(g_magic) && memcmp(buf.data(), g_magic, sizeof(g_magic)) == 0)
+    {
+        uint32_t flags;
+        uint64_t cnt;
+        if (bend < SEEDLIST_HEADER || !readHeader((const uchar*) buf.data(), &flags, &cnt))
+        {
+            close();
+            return false;
+        }
+        binary = true;
+        start = pos = bpos = SEEDLIST_HEADER;
+        len = SEEDLIST_HEADER + cnt * sizeof(uint64_t);
+    }
+    return true;
+}
+
+void SeedStream::close()
+{
+    if (fp && fp != stdin)
+        fclose(fp);
+    fp = NULL;
+    buf.clear();
+    bpos = bend = 0;
+}
+
+bool SeedStream::fill()
+{
+    if (bpos > 0)
+    {
+        memmove(buf.data(), buf.data() + bpos, bend - bpos);
+        bend -= bpos;
+        bpos = 0;
+    }
+    size_t n = fread(buf.data() + bend, 1, buf.size() - bend, fp);
+    bend += n;
+    return n > 0;
+}
+
+bool SeedStream::seek(uint64_t offset)
+{
+    if (!fp || offset < start)
+        return false;
+    if (fp != stdin)
+    {
+#if defined(_WIN32)
+        if (_fseeki64(fp, offset, SEEK_SET) != 0)
+#else
+        if (fseeko(fp, (off_t) offset, SEEK_SET) != 0)
+#endif
+            return false;
+        bpos = bend = 0;
+        pos = offset;
+        skipline = false;
+        return true;
+    }
+    // a pipe is skipped up to the offset
+    if (offset < pos)
+        return false;
+    while (pos < offset)
+    {
+        if (bpos == bend && !fill())
+            return false;
+        uint64_t n = bend - bpos;
+        if (n > offset - pos)
+            n = offset - pos;
+        bpos += n;
+        pos += n;
+    }
+    return true;
+}
+
+uint64_t SeedStream::read(std::vector<uint64_t>& seeds, size_t max)
+{
+    seeds.clear();
+    if (!fp)
+        return 0;
+    uint64_t begin = pos;
+    while (seeds.size() < max && pos < len)
+    {
+        const char *p = buf.data() + bpos;
+        size_t avail = bend - bpos;
+        if (binary)
+        {
+            if (avail < sizeof(uint64_t))
+            {
+                if (fill())
+                    continue;
+                break; // end of input (or a truncated seed)
+            }
+            seeds.push_back(qFromLittleEndian<quint64>(p));
+            bpos += sizeof(uint64_t);
+            pos += sizeof(uint64_t);
+            continue;
+        }
+
+        // one seed per line, other lines are skipped (as with loadSavedSeeds)
+        const char *nl = (const char*) memchr(p, '\n', avail);
+        if (!nl && fill())
+            continue;
+        size_t n = nl ? nl - p + 1 : avail;
+        if (n == 0)
+            break; // end of input
+        if (!skipline)
+        {
+            char line[32];
+            size_t k = n < sizeof(line) - 1 ? n : sizeof(line) - 1;
+            memcpy(line, p, k);
+            line[k] = 0;
+            int64_t s;
+            if (sscanf(line, "%" SCNd64, &s) == 1)
+                seeds.push_back((uint64_t) s);
+        }
+        // a line that does not fit into the buffer continues in the next one
+        skipline = (nl == NULL);
+        bpos += n;
+        pos += n;
+    }
+    return pos - begin;
+}
+
+
+bool isBinarySeedList(QString path)
+{
+    QFile f(path);
+    char magic[sizeof(g_magic)];
+    return f.open(QIODevice::ReadOnly) &&
+        f.read(magic, sizeof(magic)) == sizeof(magic) &&
+        memcmp(magic, g_magic, sizeof(magic)) == 0;
+}
+
+bool loadSeedList(QString path, std::vector<uint64_t>& seeds)
+{
+    if (isBinarySeedList(path))
+    {
+        SeedList l;
+        if (!l.map(path))
+            return false;
+        seeds.assign(l.begin(), l.end());
+        return true;
+    }
+    QByteArray ba = path.toLocal8Bit();
+    uint64_t len;
+    if (uint64_t *l = loadSavedSeeds(ba.data(), &len))
+    {
+        seeds.assign(l, l+len);
+        free(l);
+        return true;
+    }
+    return false;
+}
+
+// Writes seeds in blocks, keeping track of the count and order.
+struct SeedWriter
+{
+    enum { BLOCK = 4096 };
+
+    QFile *fp;
+    uint64_t buf[BLOCK];
+    int n;
+    uint64_t cnt;
+    uint64_t prev;
+    bool sorted;
+
+    bool open(QFile *f)
+    {
+        fp = f;
+        n = 0;
+        cnt = 0;
+        prev = 0;
+        sorted = true;
+        uchar head[SEEDLIST_HEADER] = {};
+        return fp->write((const char*) head, sizeof(head)) == sizeof(head);
+    }
+    bool flush()
+    {
+        qint64 k = n * sizeof(*buf);
+        bool ok = n == 0 || fp->write((const char*) buf, k) == k;
+        n = 0;
+        return ok;
+    }
+    bool add(uint64_t s)
+    {
+        if (cnt && s <= prev)
+            sorted = false;
+        prev = s;
+        cnt++;
+        buf[n++] = qToLittleEndian<quint64>(s);
+        return n < BLOCK || flush();
+    }
+    // complete the header (the file stays open)
+    bool finish()
+    {
+        uchar head[SEEDLIST_HEADER];
+        writeHeader(head, sorted ? SEEDLIST_SORTED : 0, cnt);
+        return flush() && fp->seek(0) &&
+            fp->write((const char*) head, sizeof(head)) == sizeof(head) &&
+            fp->flush();
+    }
+};
+
+bool saveSeedList(QString path, const uint64_t *seeds, uint64_t n)
+{
+    QFile f(path);
+    if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        return false;
+    SeedWriter w;
+    bool ok = w.open(&f);
+    for (uint64_t i = 0; i < n && ok; i++)
+        ok = w.add(seeds[i]);
+    ok = ok && w.finish();
+    f.close();
+    if (!ok)
+        QFile::remove(path);
+    return ok;
+}
+
+int64_t convertSeedList(QString txtpath, QString binpath)
+{
+    QByteArray ba = txtpath.toLocal8Bit();
+    FILE *in = fopen(ba.data(), "r");
+    if (!in)
+        return -1;
+    QFile out(binpath);
+    if (!out.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        fclose(in);
+        return -1;
+    }
+    SeedWriter w;
+    bool ok = w.open(&out);
+
+    // one seed per line, other lines are skipped (as with loadSavedSeeds)
+    char line[256];
+    while (ok && fgets(line, sizeof(line), in))
+    {
+        if (!strchr(line, '\n'))
+        {   // skip the rest of an overlong line
+            int c;
+            while ((c = fgetc(in)) != EOF && c != '\n');
+        }
+        int64_t s;
+        if (sscanf(line, "%" SCNd64, &s) == 1)
+            ok = w.add((uint64_t) s);
+    }
+    ok &= !ferror(in);
+    fclose(in);
+    ok = ok && w.finish();
+    out.close();
+    if (!ok)
+    {
+        QFile::remove(binpath);
+        return -1;
+    }
+    return (int64_t) w.cnt;
+}
+
+
+SeedSorter::SeedSorter()
+    : threads(1)
+    , budget((uint64_t)1 << 30)
+    , mask(~(uint64_t)0)
+    , progress()
+    , abort()
+    , done()
+    , total()
+{
+}
+
+bool SeedSorter::report()
+{
+    if (abort)
+        return false;
+    if (progress && !progress(total ? (double) done / total : 0))
+        abort = true;
+    return !abort;
+}
+
+bool SeedSorter::runParallel(int cnt, const std::function<void(int)>& fn)
+{
+    // the calling thread reports the progress while the workers run
+    std::atomic_int running(cnt);
+    std::vector<std::thread> tv;
+    for (int t = 0; t < cnt; t++)
+        tv.emplace_back([&, t]() { fn(t); running--; });
+    while (running > 0)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        report();
+    }
+    for (std::thread& th : tv)
+        th.join();
+    return !abort;
+}
+
+bool SeedSorter::radixSort(std::vector<uint64_t>& a, std::vector<uint64_t>& tmp)
+{
+    enum { RADIX = 16, BUCKETS = 1 << RADIX, STEP = 1 << 16 };
+
+    uint64_t n = a.size();
+    int bits = 0;
+    while (bits < 64 && (mask >> bits))
+        bits++;
+    int passes = (bits + RADIX - 1) / RADIX;
+    int tcnt = n < ((uint64_t)1 << 20) || threads < 1 ? 1 : threads;
+    std::vector<uint64_t> cnt((size_t) tcnt * BUCKETS);
+    uint64_t *src = a.data();
+    uint64_t *dst = tmp.data();
+
+    for (int p = 0; p < passes; p++)
+    {
+        int shift = p * RADIX;
+        bool ok = runParallel(tcnt, [&](int t) {
+            uint64_t *c = &cnt[(size_t) t * BUCKETS];
+            std::fill(c, c + BUCKETS, 0);
+            uint64_t b = n * t / tcnt, e = n * (t+1) / tcnt;
+            for (uint64_t i = b; i < e && !abort; i += STEP)
+            {
+                uint64_t ie = e - i < STEP ? e : i + STEP;
+                for (uint64_t j = i; j < ie; j++)
+                {
+                    if (p == 0)
+                        src[j] &= mask;
+                    c[(src[j] >> shift) & (BUCKETS-1)]++;
+                }
+                done += ie - i;
+            }
+        });
+        if (!ok)
+            return false;
+
+        // the runs of each bucket follow the order of the threads
+        uint64_t sum = 0;
+        for (int d = 0; d < BUCKETS; d++)
+        {
+            for (int t = 0; t < tcnt; t++)
+            {
+                uint64_t k = cnt[(size_t) t * BUCKETS + d];
+                cnt[(size_t) t * BUCKETS + d] = sum;
+                sum += k;
+            }
+        }
+
+        ok = runParallel(tcnt, [&](int t) {
+            uint64_t *c = &cnt[(size_t) t * BUCKETS];
+            uint64_t b = n * t / tcnt, e = n * (t+1) / tcnt;
+            for (uint64_t i = b; i < e && !abort; i += STEP)
+            {
+                uint64_t ie = e - i < STEP ? e : i + STEP;
+                for (uint64_t j = i; j < ie; j++)
+                    dst[c[(src[j] >> shift) & (BUCKETS-1)]++] = src[j];
+                done += ie - i;
+            }
+        });
+        if (!ok)
+            return false;
+        std::swap(src, dst);
+    }
+    if (src != a.data())
+        a.swap(tmp);
+    return true;
+}
+
+static QTemporaryFile *newTempFile()
+{
+    QTemporaryFile *f = new QTemporaryFile(QDir::tempPath() + "/cubiomes-viewer-XXXXXX.seeds");
+    if (!f->open())
+    {
+        delete f;
+        return nullptr;
+    }
+    return f;
+}
+
+bool SeedSorter::sort(SeedList& seeds)
+{
+    typedef std::pair<uint64_t, size_t> Entry; // (seed, run)
+
+    abort = false;
+    done = 0;
+
+    uint64_t n = seeds.size();
+    int bits = 0;
+    while (bits < 64 && (mask >> bits))
+        bits++;
+    uint64_t passes = (bits + 15) / 16;
+    // the radix passes need a second buffer
+    uint64_t runlen = budget / (2 * sizeof(uint64_t));
+    if (runlen < ((uint64_t)1 << 20))
+        runlen = (uint64_t)1 << 20;
+
+    std::vector<uint64_t> a, tmp;
+    try {
+        if (n <= runlen)
+        {
+            total = 2 * passes * n;
+            if (seeds.isMapped())
+                seeds.read(0, n, a);
+            else
+                a.swap(seeds.edit());
+            seeds.clear();
+            tmp.resize(n);
+            if (!radixSort(a, tmp))
+                return false;
+            tmp = std::vector<uint64_t>();
+            a.erase(std::unique(a.begin(), a.end()), a.end());
+            seeds.take(a, true);
+            return true;
+        }
+
+        // sort the runs that fit into the budget and spill them to disk
+        total = 2 * passes * n + n;
+        std::vector<std::shared_ptr<QFile>> runs;
+        for (uint64_t i = 0; i < n; i += runlen)
+        {
+            seeds.read(i, runlen, a);
+            tmp.resize(a.size());
+            if (!radixSort(a, tmp))
+            {
+                seeds.clear();
+                return false;
+            }
+            a.erase(std::unique(a.begin(), a.end()), a.end());
+            std::shared_ptr<QFile> f(newTempFile());
+            SeedWriter w;
+            bool ok = f && w.open(f.get());
+            for (size_t j = 0; j < a.size() && ok; j++)
+                ok = w.add(a[j]);
+            if (!ok || !w.finish())
+            {
+                seeds.clear();
+                return false;
+            }
+            runs.push_back(f);
+        }
+        a = std::vector<uint64_t>();
+        tmp = std::vector<uint64_t>();
+        seeds.clear();
+
+        // merge the runs into the output list
+        std::vector<SeedList> in(runs.size());
+        std::vector<uint64_t> step(runs.size());
+        std::vector<Entry> heap;
+        for (size_t k = 0; k < runs.size(); k++)
+        {
+            if (!in[k].map(runs[k]))
+                return false;
+            if (!in[k].empty())
+                heap.push_back(Entry(in[k][0], k));
+        }
+        std::make_heap(heap.begin(), heap.end(), std::greater<Entry>());
+
+        std::shared_ptr<QFile> out(newTempFile());
+        SeedWriter w;
+        bool ok = out && w.open(out.get());
+        uint64_t i = 0;
+        while (ok && !heap.empty())
+        {
+            std::pop_heap(heap.begin(), heap.end(), std::greater<Entry>());
+            Entry e = heap.back();
+            heap.pop_back();
+            size_t k = e.second;
+            if (++step[k] < in[k].size())
+            {
+                heap.push_back(Entry(in[k][step[k]], k));
+                std::push_heap(heap.begin(), heap.end(), std::greater<Entry>());
+            }
+            if (w.cnt == 0 || e.first != w.prev)
+                ok = w.add(e.first);
+            if ((++i & 0xfffff) == 0)
+            {
+                done += 0x100000;
+                ok = ok && report();
+            }
+        }
+        ok = ok && w.finish();
+        in.clear();
+        runs.clear();
+        return ok && seeds.map(out);
+    } catch (...) {
+        seeds.clear();
+        return false;
+    }
+}
@@ -0,0 +1,235 @@
+#ifndef SEEDLIST_H
+#define SEEDLIST_H
+
+#include <QString>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <stdint.h>
+#include <stdio.h>
+
+class QFile;
+class TransposedList;
+struct TransposeMerger;
+
+/* Binary seed list: a header followed by the seeds as little-endian 64-bit
+ * integers, so that a list can be mapped into memory as it is.
+ *
+ *  char[8]  "CVSEEDS\0"
+ *  uint32   version
+ *  uint32   flags
+ *  uint64   number of seeds
+ */
+enum { SEEDLIST_VERSION = 1 };
+enum { SEEDLIST_HEADER = 24 };
+// the seeds are in ascending (unsigned) order, without duplicates
+enum { SEEDLIST_SORTED = 1 };
+
+/* A read-only list of seeds that is held in memory or mapped from a binary
+ * seed list. Copies of a mapped list share the mapping.
+ *
+ * A transposed list is not stored at all: its entries are merged on the fly
+ * (see TransposedList), and data() is then unavailable.
+ */
+class SeedList
+{
+public:
+    SeedList();
+
+    // Map a binary seed list (or read it on big-endian hosts).
+    bool map(QString path);
+    // Map an open binary seed list, which is kept open with the list.
+    bool map(std::shared_ptr<QFile> file);
+    void assign(const std::vector<uint64_t>& seeds);
+    // Take over the seeds of a vector (the vector is consumed).
+    void take(std::vector<uint64_t>& seeds, bool sorted = false);
+    void clear();
+
+    // Get the list as a vector that can be modified (this copies a mapping).
+    std::vector<uint64_t>& edit();
+
+    // Replace the list by the sorted union of its 48-bit seeds moved by each
+    // of the offsets (modulo 2^48), without storing the union. The progress
+    // of the indexing pass is reported as with SeedSorter::progress.
+    bool transpose(const std::vector<uint64_t>& offsets,
+        const std::function<bool(double)>& progress = nullptr);
+
+    bool isMapped() const { return file != nullptr; }
+    bool isSorted() const { return sorted; }
+    bool isTransposed() const { return merged != nullptr; }
+
+    const uint64_t *data() const { return file ? ptr : vec.data(); }
+    uint64_t size() const { return file || merged ? len : vec.size(); }
+    bool empty() const { return size() == 0; }
+    const uint64_t *begin() const { return data(); }
+    const uint64_t *end() const { return data() + size(); }
+    uint64_t back() const { return (*this)[size() - 1]; }
+    uint64_t operator[](uint64_t i) const { return merged ? at(i) : data()[i]; }
+
+    // Index of the first seed that is not less (or greater) than 'v' in a
+    // sorted list.
+    uint64_t lowerBound(uint64_t v) const;
+    uint64_t upperBound(uint64_t v) const;
+    // Copy up to 'n' seeds starting at index 'idx'.
+    void read(uint64_t idx, uint64_t n, std::vector<uint64_t>& out) const;
+
+private:
+    friend class SeedCursor;
+
+    uint64_t at(uint64_t i) const;
+
+    std::vector<uint64_t> vec;
+    std::shared_ptr<QFile> file;
+    std::shared_ptr<const TransposedList> merged;
+    const uint64_t *ptr;
+    uint64_t len;
+    bool sorted;
+};
+
+/* The sorted union of the streams (s + d_j) mod 2^48 of a sorted 48-bit base
+ * list s, for offsets d_j. Each stream is the base list rotated at the seed
+ * that wraps around, so the streams can be k-way merged as they are, which
+ * needs memory for the base list and the merge state only.
+ *
+ * The union is counted once, keeping every MARK_STEP-th seed as a mark: an
+ * index is then reached by restarting the merge at its mark, which keeps the
+ * indices the same as those of the materialized list.
+ */
+class TransposedList
+{
+public:
+    enum { MARK_STEP = 4096 };
+
+    TransposedList(SeedList&& base, const std::vector<uint64_t>& offsets);
+    // Count the union and set the marks, returns false if aborted.
+    bool index(const std::function<bool(double)>& progress);
+
+    uint64_t size() const { return len; }
+    uint64_t at(uint64_t idx) const;
+    uint64_t lowerBound(uint64_t v) const;
+    void read(uint64_t idx, uint64_t n, std::vector<uint64_t>& out) const;
+
+private:
+    friend struct TransposeMerger;
+    friend class SeedCursor;
+
+    SeedList base;
+    std::vector<uint64_t> offs;
+    std::vector<uint64_t> rot;      // base index where each stream begins
+    std::vector<uint64_t> marks;
+    uint64_t len;
+};
+
+/* Reads windows of a seed list in ascending order of index. For a transposed
+ * list the merge state is kept between the reads, so a window that follows
+ * the previous one continues the merge, and only a jump (backwards, or over
+ * more than a mark) restarts it at a mark.
+ */
+class SeedCursor
+{
+public:
+    SeedCursor();
+    ~SeedCursor();
+
+    // Copy up to 'n' seeds of the list starting at index 'idx'.
+    void read(const SeedList& list, uint64_t idx, uint64_t n,
+        std::vector<uint64_t>& out);
+
+private:
+    void seek(uint64_t idx);
+
+    std::shared_ptr<const TransposedList> src;
+    std::unique_ptr<TransposeMerger> merger;
+    uint64_t pos;       // index of the next seed of the merge
+};
+
+/* Sorts the seeds of a list and removes the duplicates, with several threads
+ * that run least significant digit radix passes over the masked seeds. A
+ * list that exceeds the memory budget is sorted in runs which are spilled to
+ * temporary files and then merged into a temporary binary seed list, that
+ * is mapped (and removed once the list is released).
+ */
+class SeedSorter
+{
+public:
+    SeedSorter();
+
+    // Sort the list, which is left empty if the sort fails or is aborted.
+    bool sort(SeedList& seeds);
+
+    int threads;
+    uint64_t budget;    // memory for the sort in bytes
+    uint64_t mask;      // applied to the seeds before they are sorted
+    // Called on the sorting thread with the completed fraction, returns
+    // false to abort the sort.
+    std::function<bool(double)> progress;
+
+private:
+    bool radixSort(std::vector<uint64_t>& a, std::vector<uint64_t>& tmp);
+    bool runParallel(int cnt, const std::function<void(int)>& fn);
+    bool report();
+
+    std::atomic_bool abort;
+    std::atomic_uint64_t done;
+    uint64_t total;
+};
+
+/* Sequential reader of a text or binary seed list from a file, or from the
+ * standard input ("-"). Its positions are byte offsets in the input, which
+ * always fall on line (or seed) boundaries between reads, so that a reader
+ * can later seek straight back to them.
+ */
+class SeedStream
+{
+public:
+    SeedStream();
+    ~SeedStream();
+
+    bool open(QString path);
+    void close();
+    bool isOpen() const { return fp != NULL; }
+
+    // offset of the first seed and size of the input (~0 when unknown)
+    uint64_t first() const { return start; }
+    uint64_t size() const { return len; }
+    uint64_t offset() const { return pos; }
+
+    // Continue at an offset. (The standard input only moves forward.)
+    bool seek(uint64_t offset);
+
+    // Read up to 'max' seeds, returns the number of bytes consumed (0 at
+    // the end). A read may consume bytes without producing any seeds.
+    uint64_t read(std::vector<uint64_t>& seeds, size_t max);
+
+private:
+    bool fill();
+
+    enum { BUFSIZE = 1 << 20 };
+
+    FILE *fp;
+    bool binary;
+    bool skipline;      // the rest of an overlong line is skipped
+    uint64_t start;
+    uint64_t len;
+    uint64_t pos;
+    std::vector<char> buf;
+    size_t bpos, bend;
+};
+
+// Is the file a binary seed list?
+bool isBinarySeedList(QString path);
+
+// Load a text or binary seed list into memory.
+bool loadSeedList(QString path, std::vector<uint64_t>& seeds);
+
+// Write a binary seed list.
+bool saveSeedList(QString path, const uint64_t *seeds, uint64_t n);
+
+// Convert a text seed list to the binary format line by line, so that the
+// list never has to fit in memory. Returns the number of seeds, or -1.
+int64_t convertSeedList(QString txtpath, QString binpath);
+
+#endif // SEEDLIST_H
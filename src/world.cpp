@@ -1,5 +1,6 @@
 #include "world.h"
 
+#include "cpudispatch.h"
 #include "util.h"
 
 #include <QPainterPath>
@@ -328,55 +329,12 @@ void applyHeightShading(unsigned char *rgb, Range r,
     if (abort && *abort) return;
     // apply shading based on height changes
     float mul = 0.25 / r.scale;
-    float lout = 0.65;
-    float lmin = 0.5;
-    float lmax = 1.5;
     float ymax = r.scale == 1 ? r.y : r.y << 2;
-    for (int j = 0; j < h; j++)
-    {
-        for (int i = 0; i < w; i++)
-        {
-            int tw = w+2;
-            float t01 = height[(j+0)*tw + i+1];
-            float t10 = height[(j+1)*tw + i+0];
-            float t11 = height[(j+1)*tw + i+1];
-            float t12 = height[(j+1)*tw + i+2];
-            float t21 = height[(j+2)*tw + i+1];
-            float d0 = t01 + t10;
-            float d1 = t12 + t21;
-            float light = 1.0;
-            uchar *col = rgb + 3*(j*w + i);
-            if (mode == HV_GRAYSCALE)
-            {
-                if (t11 <= -64)
-                {   // sinkhole in 1.19.0 - 1.19.2
-                    col[0] = 0xff; col[1] = col[2] = 0;
-                    continue;
-                }
-                float v = t11;
-                uchar c = (v <= 0) ? 0 : (v > 0xff) ? 0xff : (uchar)(v);
-                col[0] = col[1] = col[2] = c;
-                continue;
-            }
-            if (mode == HV_SHADING || mode == HV_CONTOURS_SHADING)
-                light += (d1 - d0) * mul;
-            if (t11 > ymax) light = lout;
-            if (light < lmin) light = lmin;
-            if (light > lmax) light = lmax;
-            if (mode == HV_CONTOURS || mode == HV_CONTOURS_SHADING)
-            {
-                float spacing = 16.0;
-                float tmin = std::min({t01, t10, t12, t21});
-                if (floor(tmin / spacing) != floor(t11 / spacing))
-                    light *= 0.5;
-            }
-            for (int k = 0; k < 3; k++)
-            {
-                float c = col[k] * light;
-                col[k] = (c <= 0) ? 0 : (c > 0xff) ? 0xff : (uchar)(c);
-            }
-        }
-    }
+    getCpuKernels().shadeHeight(rgb, height.data(), w, h,
+        mode == HV_GRAYSCALE,
+        mode == HV_SHADING || mode == HV_CONTOURS_SHADING,
+        mode == HV_CONTOURS || mode == HV_CONTOURS_SHADING,
+        mul, ymax);
 }
 
 void Quad::updateBiomeColor()
@@ -391,12 +349,7 @@ void Quad::updateBiomeColor()
         const int *extremes = getBiomeParaExtremes(g->mc);
         int cmin = extremes[nptype*2 + 0];
         int cmax = extremes[nptype*2 + 1];
-        for (int i = 0; i < r.sx * r.sz; i++)
-        {
-            double p = (biomes[i] - cmin) / (double) (cmax - cmin);
-            uchar col = (p <= 0) ? 0 : (p >= 1.0) ? 0xff : (uchar)(0xff * p);
-            rgb[3*i+0] = rgb[3*i+1] = rgb[3*i+2] = col;
-        }
+        getCpuKernels().climateToGray(rgb, biomes, r.sx * r.sz, cmin, cmax);
     }
     else
     {
@@ -1246,14 +1199,8 @@ void QWorld::draw(QPainter& painter, int vw, int vh, qreal focusx, qreal focusz,
             slimex = x;
             slimez = z;
 
-            for (int j = 0; j < h; j++)
-            {
-                for (int i = 0; i < w; i++)
-                {
-                    int isslime = isSlimeChunk(wi.seed, i+x, j+z);
-                    slimeimg.setPixel(i, j, isslime);
-                }
-            }
+            getCpuKernels().mapSlime(slimeimg.bits(), slimeimg.bytesPerLine(),
+                wi.seed, x, z, w, h);
         }
 
         qreal ps = 16 * blocks2pix;